@@ -1,4 +1,6 @@
 #include "CubicRegression.h"
+#include "PolynomialDegreeRegression.h"
+#include "SummationKernels.h"
 
 const float CubicRegression::DEFAULT_SENSITIVITY = 0.35f;
 
@@ -26,7 +28,29 @@ float CubicRegression::CubicModel::ModeledX(float y)
     }
 }
 
-CubicRegression::CubicConsensusModel& CubicRegression::CalculateCubicRegressionConsensus(vector<PointF> points, enmIndependentVariable independentVariable, float sensitivity)
+// The modeled value minus the observed value of the dependent variable, as CalculateSignedRegressionError, in one 
+// loop with the axes swapped once for a y independent variable
+void CubicRegression::CubicModel::CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors)
+{
+    if (!ValidRegressionModel)
+    {
+        RegressionModel::CalculateSignedRegressionErrors(points, errors);
+        return;
+    }
+
+    auto xIndependent = independentVariable == enmIndependentVariable::X;
+    auto xs = xIndependent ? points.Xs() : points.Ys();
+    auto ys = xIndependent ? points.Ys() : points.Xs();
+    auto stride = points.Stride();
+    auto N = points.Count();
+    for (auto i = 0; i < N; ++i)
+    {
+        auto x = xs[i * stride];
+        errors[i] = (float)(b1 + b2 * x + b3 * x * x + b4 * x * x * x) - ys[i * stride];
+    }
+}
+
+CubicRegression::CubicConsensusModel& CubicRegression::CalculateCubicRegressionConsensus(const vector<PointF>& points, enmIndependentVariable independentVariable, float sensitivity)
 {
     auto consensus = new CubicConsensusModel(independentVariable);
     consensus->Calculate(points, sensitivity);
@@ -34,6 +58,14 @@ CubicRegression::CubicConsensusModel& CubicRegression::CalculateCubicRegressionC
     return *consensus;
 }
 
+CubicRegression::CubicConsensusModel& CubicRegression::CalculateCubicRegressionConsensus(const vector<PointF>& points, CubicConsensusModel& prior, float sensitivity)
+{
+    auto consensus = new CubicConsensusModel(static_cast<CubicModel&>(*prior.model).independentVariable);
+    consensus->CalculateWarmStart(points, sensitivity, *prior.model, prior.inlierMask);
+
+    return *consensus;
+}
+
 float CubicRegression::CubicConsensusModel::CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide)
 {
     if (point.IsEmpty)
@@ -43,7 +75,7 @@ float CubicRegression::CubicConsensusModel::CalculateError(RegressionModel& mode
     }
 
     auto error = 0.0f;
-    auto qmodel = static_cast<CubicModel&>(model);
+    auto& qmodel = static_cast<CubicModel&>(model);
     if (qmodel.independentVariable == enmIndependentVariable::X)
     {
         error = qmodel.ModeledY(point.X) - point.Y;
@@ -57,63 +89,128 @@ float CubicRegression::CubicConsensusModel::CalculateError(RegressionModel& mode
     return abs(error);
 }
 
-RegressionModel::Summations* CubicRegression::CubicModel::CalculateSummations(vector<PointF> points)
+// The same error as CalculateError from the residuals cached when the model was scored
+void CubicRegression::CubicConsensusModel::ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex)
 {
-    CubicSummations* sum = new CubicSummations();
-    if (points.size() < MinimumPoints)
+    auto& qmodel = static_cast<CubicModel&>(model);
+    if (!ResidualsAvailable(qmodel))
     {
-        sum->N = 0;
-        return sum;
+        RegressionConsensusModel::ScanCandidates(model, positiveIndex, negativeIndex, influenceIndex);
+        return;
     }
 
-    // Initialize all the summations to zero
-    sum->x = 0.0;
-    sum->y = 0.0;
-    sum->xy = 0.0;
-    sum->x2y = 0.0;  // (i.e.  SUM(x^2*y))
-    sum->x3y = 0.0;
-    sum->x2 = 0.0;
-    sum->x3 = 0.0;
-    sum->x4 = 0.0;
-    sum->x5 = 0.0;
-    sum->x6 = 0.0;
-
-    // Shorthand that better matches the math formulas
-    auto N = sum->N = (int)points.size();
-
-    // Calculate the summations
-    for (auto i = 0; i < N; ++i)
-    {
-        // Shorthand
-        auto x = (double)points[i].X;
-        auto y = (double)points[i].Y;
+    auto useCooksDistance = influenceError == InfluenceError::CooksDistance && CalculateCooksDistances(qmodel);
 
-        // Meh
-        if (independentVariable == enmIndependentVariable::Y)
+    RegressionConsensusModel::ScanCandidates(
+        [&](int i, PointF point, bool& pointOnPositiveSide)
         {
-            // Swap the x and y coordinates to handle a y independent variable
-            x = points[i].Y;
-            y = points[i].X;
-        }
+            auto error = qmodel.residuals[i];
+            pointOnPositiveSide = !point.IsEmpty & (error >= 0.0f);
+            return point.IsEmpty ? 99999999.9f : abs(error);
+        },
+        [&](int i, PointF point) { return useCooksDistance ? influences[i] : CalculateDistanceInfluence(influenceError, point, qmodel); },
+        positiveIndex, negativeIndex, influenceIndex);
+}
 
-        auto xx = x * x;
-        auto xy = x * y;
-        auto xxx = xx * x;
-
-        // Sums
-        sum->x += x;
-        sum->y += y;
-        sum->xy += xy;
-        sum->x2y += xx * y;
-        sum->x3y += xxx * y;
-        sum->x2 += xx;
-        sum->x3 += xxx;
-        sum->x4 += xx * xx;
-        sum->x5 += xxx * xx;
-        sum->x6 += xxx * xxx;
+void CubicRegression::CubicModel::CalculateSummations(const PointCloud2D& points, Summations& sums)
+{
+    auto& sum = static_cast<CubicSummations&>(sums);
+    if (points.Count() < MinimumPoints)
+    {
+        sum.N = 0;
+        return;
     }
 
-    return sum;
+    // The power sums of the points with the model's bias removed, the same way UpdateSummations does.  The x and 
+    // y arrays (and biases) swap to handle a y independent variable.
+    auto xIndependent = independentVariable == enmIndependentVariable::X;
+    auto xs = xIndependent ? points.Xs() : points.Ys();
+    auto ys = xIndependent ? points.Ys() : points.Xs();
+    auto biasX = (float)(xIndependent ? bias.x : bias.y);
+    auto biasY = (float)(xIndependent ? bias.y : bias.x);
+    double sumX[7];
+    double sumXY[4];
+    SummationKernels::PolynomialSums(xs, ys, points.Count(), points.Stride(), biasX, biasY, 3, sumX, sumXY, sum.y2);
+
+    sum.N = points.Count();
+    sum.x = sumX[1];
+    sum.x2 = sumX[2];
+    sum.x3 = sumX[3];
+    sum.x4 = sumX[4];
+    sum.x5 = sumX[5];
+    sum.x6 = sumX[6];
+    sum.y = sumXY[0];
+    sum.xy = sumXY[1];
+    sum.x2y = sumXY[2];
+    sum.x3y = sumXY[3];
+}
+
+void CubicRegression::CubicModel::ShiftSummations(Summations& sums, double dx, double dy)
+{
+    CubicSummations& sum = static_cast<CubicSummations&>(sums);
+    if (independentVariable == enmIndependentVariable::Y)
+    {
+        // The summations are of the swapped coordinates
+        swap(dx, dy);
+    }
+
+    double sumX[] = { (double)sum.N, sum.x, sum.x2, sum.x3, sum.x4, sum.x5, sum.x6 };
+    double sumXY[] = { sum.y, sum.xy, sum.x2y, sum.x3y };
+    ShiftPowerSums(sumX, 6, sumXY, 3, sum.y2, dx, dy);
+    sum.x = sumX[1];
+    sum.x2 = sumX[2];
+    sum.x3 = sumX[3];
+    sum.x4 = sumX[4];
+    sum.x5 = sumX[5];
+    sum.x6 = sumX[6];
+    sum.y = sumXY[0];
+    sum.xy = sumXY[1];
+    sum.x2y = sumXY[2];
+    sum.x3y = sumXY[3];
+}
+
+void CubicRegression::CubicModel::UpdateSummations(Summations& sums, PointF point, double weight)
+{
+    CubicSummations& sum = static_cast<CubicSummations&>(sums);
+
+    // Remove the bias the same way the summations were calculated
+    auto x = (double)(point.X - (float)bias.x);
+    auto y = (double)(point.Y - (float)bias.y);
+
+    if (independentVariable == enmIndependentVariable::Y)
+    {
+        // Swap the x and y coordinates to handle a y independent variable
+        swap(x, y);
+    }
+
+    auto xx = x * x;
+    auto xy = x * y;
+    auto xxx = xx * x;
+
+    // Sums
+    sum.N += (int)weight;
+    sum.x += weight * x;
+    sum.y += weight * y;
+    sum.xy += weight * xy;
+    sum.x2y += weight * xx * y;
+    sum.x3y += weight * xxx * y;
+    sum.x2 += weight * xx;
+    sum.x3 += weight * xxx;
+    sum.x4 += weight * xx * xx;
+    sum.x5 += weight * xxx * xx;
+    sum.x6 += weight * xxx * xxx;
+    sum.y2 += weight * y * y;
+}
+
+double CubicRegression::CubicModel::CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight)
+{
+    return UpdatedResidualSumOfSquares(*this, static_cast<CubicSummations&>(sums), point, weight);
+}
+
+void CubicRegression::CubicModel::CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+    double* residualSumsOfSquares)
+{
+    UpdatedResidualSumsOfSquares(*this, static_cast<CubicSummations&>(sums), points, mask, weight, residualSumsOfSquares);
 }
 
 void CubicRegression::CubicModel::CalculateFeatures()
@@ -148,6 +245,7 @@ void CubicRegression::CubicModel::CalculateModel(Summations& sums)
     auto sY1 = sum.xy - inv_N * sum.x * sum.y;
     auto sY2 = sum.x2y - inv_N * sum.x2 * sum.y;
     auto sY3 = sum.x3y - inv_N * sum.x3 * sum.y;
+    auto sYY = sum.y2 - inv_N * sum.y * sum.y;
 
     // Calculate the inverse matrix of S (inv(S)) using T notation
     // (see notes above)
@@ -172,6 +270,25 @@ void CubicRegression::CubicModel::CalculateModel(Summations& sums)
     b4 = (sY1 * t13 + sY2 * t23 + sY3 * t33) / determinantS;
     b1 = YMean - b2 * XMean - b3 * XXMean - b4 * XXXMean;
 
+    // The residual sum of squares, sYY - b2*sY1 - b3*sY2 - b4*sY3
+    residualSumOfSquares = max(0.0, sYY - b2 * sY1 - b3 * sY2 - b4 * sY3);
+
+    // Keep the normal equations for the regression diagnostics
+    normalEquations.N = sum.N;
+    normalEquations.yMean = YMean;
+    normalEquations.powerMeans[0] = XMean;
+    normalEquations.powerMeans[1] = sum.x2 / (double)sum.N;
+    normalEquations.powerMeans[2] = XXXMean;
+    normalEquations.coefficients[0] = b2;
+    normalEquations.coefficients[1] = b3;
+    normalEquations.coefficients[2] = b4;
+    normalEquations.inverseS[0][0] = t11 / determinantS;
+    normalEquations.inverseS[0][1] = normalEquations.inverseS[1][0] = t12 / determinantS;
+    normalEquations.inverseS[0][2] = normalEquations.inverseS[2][0] = t13 / determinantS;
+    normalEquations.inverseS[1][1] = t22 / determinantS;
+    normalEquations.inverseS[1][2] = normalEquations.inverseS[2][1] = t23 / determinantS;
+    normalEquations.inverseS[2][2] = t33 / determinantS;
+
     // Adjust for the bias
     if (independentVariable == enmIndependentVariable::X)
     {
@@ -480,3 +597,101 @@ CubicRegression::CubicConsensusModel& CubicRegression::UnitTest12(vector<PointF>
 
     return CalculateCubicRegressionConsensus(points);
 }
+
+int CubicRegression::UnitTest13(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #13:  PolynomialDegreeRegression<3> matches CubicRegression  //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The consensus of the degree 3 template on the points of each of the tests above should label the same 
+    // outliers as the cubic, with the same average regression error and the same modeled curve.
+
+    CubicConsensusModel& (*tests[])(vector<PointF>&) = { UnitTest1, UnitTest2, UnitTest3, UnitTest4, UnitTest5, UnitTest6,
+        UnitTest7, UnitTest8, UnitTest9, UnitTest10, UnitTest11, UnitTest12 };
+    auto result = 0;
+    for (auto test : tests)
+    {
+        auto& cubic = test(points);
+        auto& cubicModel = static_cast<CubicModel&>(*cubic.model);
+
+        PolynomialDegreeRegression<3>::PolynomialDegreeConsensusModel degree(cubicModel.independentVariable);
+        degree.Calculate(points, DEFAULT_SENSITIVITY);
+        auto& degreeModel = static_cast<PolynomialDegreeRegression<3>::PolynomialDegreeModel&>(*degree.model);
+
+        auto sameOutliers = cubic.outliers.size() == degree.outliers.size();
+        for (auto i = 0; sameOutliers && i < (int)cubic.outliers.size(); ++i)
+        {
+            sameOutliers = cubic.outliers[i].X == degree.outliers[i].X && cubic.outliers[i].Y == degree.outliers[i].Y;
+        }
+
+        if (cubicModel.ValidRegressionModel != degreeModel.ValidRegressionModel || !sameOutliers)
+        {
+            result = 1;
+        }
+        else if (abs(cubicModel.AverageRegressionError - degreeModel.AverageRegressionError) > 0.0001f * max(1.0f, cubicModel.AverageRegressionError))
+        {
+            result = 2;
+        }
+        else
+        {
+            for (auto point : points)
+            {
+                auto difference = cubicModel.independentVariable == enmIndependentVariable::X ? cubicModel.ModeledY(point.X) - degreeModel.ModeledY(point.X) :
+                    cubicModel.ModeledX(point.Y) - degreeModel.ModeledX(point.Y);
+                if (abs(difference) > 0.001f)
+                {
+                    result = 3;
+                }
+            }
+        }
+
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int CubicRegression::UnitTest14(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #14:  Downdating labels the outliers Recalculate labels      //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The consensus on the points of each of the tests above, refit by downdating the inliers' summations, 
+    // should remove the same outliers in the same order as recalculating the summations from the remaining 
+    // points, and end at the same average regression error to rounding.
+
+    CubicConsensusModel& (*tests[])(vector<PointF>&) = { UnitTest1, UnitTest2, UnitTest3, UnitTest4, UnitTest5, UnitTest6,
+        UnitTest7, UnitTest8, UnitTest9, UnitTest10, UnitTest11, UnitTest12 };
+    for (auto test : tests)
+    {
+        auto independentVariable = static_cast<CubicModel&>(*test(points).model).independentVariable;
+
+        CubicConsensusModel recalculated(independentVariable);
+        recalculated.refitMethod = RegressionConsensusModel::RefitMethod::Recalculate;
+        auto status = recalculated.Calculate(points, DEFAULT_SENSITIVITY);
+
+        CubicConsensusModel downdated(independentVariable);
+        downdated.refitMethod = RegressionConsensusModel::RefitMethod::Downdate;
+        if (downdated.Calculate(points, DEFAULT_SENSITIVITY) != status || downdated.model->ValidRegressionModel != recalculated.model->ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        if (downdated.outlierIndices != recalculated.outlierIndices)
+        {
+            return 2;
+        }
+
+        if (abs(downdated.model->AverageRegressionError - recalculated.model->AverageRegressionError) > 0.0001f * max(1.0f, recalculated.model->AverageRegressionError))
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
@@ -54,7 +54,7 @@ protected:
     const static float DEFAULT_SENSITIVITY;
 
 public:
-    class CubicModel : public PolynomialModel
+    class CubicModel final : public PolynomialModel
     {
     public:
         double b1;  // Coefficients of   y = b1 + b2 * x + b3 * x^2 + b4 * x^3  -OR-   x = b1 + b2 * y + b3 * y^2 + b4 * y^3
@@ -82,6 +82,7 @@ public:
             b2 = copy.b2;
             b3 = copy.b3;
             b4 = copy.b4;
+            summations = copy.summations;
         }
 
         RegressionModel* Clone() override
@@ -98,6 +99,7 @@ public:
             b2 = other.b2;
             b3 = other.b3;
             b4 = other.b4;
+            summations = other.summations;
 
             return *this;
         }
@@ -106,6 +108,8 @@ public:
 
         float ModeledX(float y) override;
 
+        void CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors) override;
+
     protected:
         class CubicSummations : public Summations
         {
@@ -118,10 +122,27 @@ public:
             double xy;
             double x2y;   // (i.e.  SUM(x^2*y))
             double x3y;
+            double y2;
         };
 
+        CubicSummations summations;
+
     public:
-        Summations* CalculateSummations(vector<PointF> points) override;
+        void CalculateSummations(const PointCloud2D& points, Summations& sums) override;
+
+        Summations& ModelSummations() override
+        {
+            return summations;
+        }
+
+        void UpdateSummations(Summations& sums, PointF point, double weight) override;
+
+        void ShiftSummations(Summations& sums, double dx, double dy) override;
+
+        double CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight) override;
+
+        void CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+            double* residualSumsOfSquares) override;
 
         void CalculateModel(Summations& sums) override;
 
@@ -140,13 +161,26 @@ public:
             outliers = vector<PointF>();
         }
 
-        CubicConsensusModel(const CubicConsensusModel& copy)
+        // Each consensus model owns (and deletes) its models, so a copy clones them
+        CubicConsensusModel(const CubicConsensusModel& copy) : RegressionConsensusModel()
         {
-            model = copy.model;
-            original = copy.original;
+            RegressionConsensusModel::operator=(copy);
+            model = copy.model->Clone();
+            original = copy.original->Clone();
+        }
 
-            inliers = copy.inliers;
-            outliers = copy.outliers;
+        CubicConsensusModel& operator=(const CubicConsensusModel& other)
+        {
+            if (this != &other)
+            {
+                delete model;
+                delete original;
+
+                RegressionConsensusModel::operator=(other);
+                model = other.model->Clone();
+                original = other.original->Clone();
+            }
+            return *this;
         }
 
         ~CubicConsensusModel()
@@ -157,9 +191,15 @@ public:
 
     protected:
         float CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide) override;
+
+        void ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex) override;
     };
 
-    static CubicConsensusModel& CalculateCubicRegressionConsensus(vector<PointF> points, enmIndependentVariable independentVariable = enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY);
+    static CubicConsensusModel& CalculateCubicRegressionConsensus(const vector<PointF>& points, enmIndependentVariable independentVariable = enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY);
+
+    // Warm start from a prior consensus (e.g. of the previous frame), keeping its independent variable.  If the prior labeled 
+    // as many points, its inlier labels are the starting inliers (the points are taken to be in the same order).
+    static CubicConsensusModel& CalculateCubicRegressionConsensus(const vector<PointF>& points, CubicConsensusModel& prior, float sensitivityInPixels = DEFAULT_SENSITIVITY);
 
 public: // Unit tests
     static CubicConsensusModel& UnitTest1(vector<PointF>& points);
@@ -174,4 +214,8 @@ public: // Unit tests
     static CubicConsensusModel& UnitTest10(vector<PointF>& points);
     static CubicConsensusModel& UnitTest11(vector<PointF>& points);
     static CubicConsensusModel& UnitTest12(vector<PointF>& points);
+
+    // Checks that return 0 on success and non-zero on failure
+    static int UnitTest13(vector<PointF>& points);
+    static int UnitTest14(vector<PointF>& points);
 };
\ No newline at end of file
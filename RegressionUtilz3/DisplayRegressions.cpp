@@ -8,6 +8,8 @@
 #include "QuadraticRegression.h"
 #include "CubicRegression.h"
 #include "EllipticalRegression.h"
+#include "PolynomialDegreeRegression.h"
+#include "SummationKernels.h"
 
 namespace plt = matplotlibcpp;
 
@@ -195,7 +197,7 @@ void DisplayRegressionPoly(string title, vector<PointF> data, PolynomialModel& f
     plt::show();
 }
 
-void DisplayRegressionEllipse(string title, vector<PointF> data, EllipticalRegression::EllipseModel& model, vector<PointF> outliers, EllipticalRegression::EllipseModel& orig)
+void DisplayRegressionEllipse(string title, vector<PointF> data, const EllipticalRegression::EllipseModel& model, vector<PointF> outliers, const EllipticalRegression::EllipseModel& orig)
 {
     // Title and data points
     double minX, maxX, minY, maxY;
@@ -274,6 +276,92 @@ int main(int argc, char** argv)
     QuadraticRegression::QuadraticConsensusModel qconsensus = QuadraticRegression::QuadraticConsensusModel(PolynomialModel::enmIndependentVariable::X);
     CubicRegression::CubicConsensusModel cconsensus = CubicRegression::CubicConsensusModel(PolynomialModel::enmIndependentVariable::X);
     EllipticalRegression::EllipseConsensusModel econsensus = EllipticalRegression::EllipseConsensusModel();
+
+    // Checks without a display; each returns 0 on success
+    if (LinearRegression::UnitTest6(points) != 0)
+    {
+        cout << "Linear Test 6 failed - Batch removal does not stop where single removal does" << endl;
+    }
+    if (LinearRegression::UnitTest7(points) != 0)
+    {
+        cout << "Linear Test 7 failed - Requery does not match Calculate" << endl;
+    }
+    if (LinearRegression::UnitTest8(points) != 0)
+    {
+        cout << "Linear Test 8 failed - A warm start without a usable prior does not fall back to Calculate" << endl;
+    }
+    if (LinearRegression::UnitTest9(points) != 0)
+    {
+        cout << "Linear Test 9 failed - Re-admission does not add back the points that fit" << endl;
+    }
+    if (LinearRegression::UnitTest10(points) != 0)
+    {
+        cout << "Linear Test 10 failed - Parallel candidate evaluation does not match serial evaluation" << endl;
+    }
+    if (LinearRegression::UnitTest11(points) != 0)
+    {
+        cout << "Linear Test 11 failed - Downdating does not label the outliers Recalculate labels" << endl;
+    }
+    if (LinearRegression::UnitTest12(points) != 0)
+    {
+        cout << "Linear Test 12 failed - The O(1) residual sum of squares does not match a refit" << endl;
+    }
+    if (EllipticalRegression::UnitTest7(points) != 0)
+    {
+        cout << "Ellipse Test 7 failed - A limit does not return its code and the best model" << endl;
+    }
+    if (EllipticalRegression::UnitTest8(points) != 0)
+    {
+        cout << "Ellipse Test 8 failed - The batch Sampson errors do not match CalculateSampsonError" << endl;
+    }
+    if (EllipticalRegression::UnitTest9(points) != 0)
+    {
+        cout << "Ellipse Test 9 failed - The batch axis distances do not match CalculateError" << endl;
+    }
+    if (EllipticalRegression::UnitTest10(points) != 0)
+    {
+        cout << "Ellipse Test 10 failed - Parallel candidate evaluation does not match serial evaluation" << endl;
+    }
+    if (EllipticalRegression::UnitTest11(points) != 0)
+    {
+        cout << "Ellipse Test 11 failed - Downdating does not label the outliers Recalculate labels" << endl;
+    }
+    if (EllipticalRegression::UnitTest12(points) != 0)
+    {
+        cout << "Ellipse Test 12 failed - The O(1) residual sum of squares does not match a refit" << endl;
+    }
+    if (EllipticalRegression::UnitTest13(points) != 0)
+    {
+        cout << "Ellipse Test 13 failed - Downdating past MAXIMUM_UPDATES does not match a fresh solve" << endl;
+    }
+    if (QuadraticRegression::UnitTest10(points) != 0)
+    {
+        cout << "Quadratic Test 10 failed - Cook's distance does not match leave-one-out refits" << endl;
+    }
+    if (QuadraticRegression::UnitTest11(points) != 0)
+    {
+        cout << "Quadratic Test 11 failed - Downdating does not label the outliers Recalculate labels" << endl;
+    }
+    if (CubicRegression::UnitTest13(points) != 0)
+    {
+        cout << "Cubic Test 13 failed - PolynomialDegreeRegression<3> does not match the cubic" << endl;
+    }
+    if (CubicRegression::UnitTest14(points) != 0)
+    {
+        cout << "Cubic Test 14 failed - Downdating does not label the outliers Recalculate labels" << endl;
+    }
+    if (PolynomialDegreeRegression<3>::UnitTest1(points) != 0 || PolynomialDegreeRegression<3>::UnitTest2(points) != 0)
+    {
+        cout << "Polynomial Degree 3 Tests failed - The fit of a degree 3 polynomial is wrong" << endl;
+    }
+    if (PolynomialDegreeRegression<8>::UnitTest1(points) != 0 || PolynomialDegreeRegression<8>::UnitTest2(points) != 0)
+    {
+        cout << "Polynomial Degree 8 Tests failed - The fit of a degree 8 polynomial is wrong" << endl;
+    }
+    if (SummationKernels::UnitTest1() != 0)
+    {
+        cout << "Summation Kernels Test 1 failed - An instruction set does not sum as the scalar loop does" << endl;
+    }
     
     consensus = LinearRegression::UnitTest4(points);
     DisplayRegressionLine("Consensus Regression splits data points into inliers and outliers\nClose figure to see the next", points, static_cast<LinearRegression::LineModel&>(*consensus.model), consensus.Outliers, static_cast<LinearRegression::LineModel&>(*consensus.original));
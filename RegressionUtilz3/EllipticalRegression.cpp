@@ -1,72 +1,382 @@
 #include "EllipticalRegression.h"
+#include "SummationKernels.h"
 #include <Eigen/Dense>
 
-using Eigen::VectorXd;
-using Eigen::MatrixXd;
+using Eigen::LDLT;
+using Eigen::Matrix;
+
+typedef Matrix<double, 5, 5> Matrix5d;
+typedef Matrix<double, 5, 1> Vector5d;
 
 const float EllipticalRegression::DEFAULT_SENSITIVITY = 0.2f;
+const double EllipticalRegression::EllipseModel::PIVOT_TOLERANCE = 1e-12;
+const double EllipticalRegression::EllipseModel::INVERSE_TOLERANCE = 1e-9;
 
 float EllipticalRegression::EllipseModel::CalculateRegressionError(PointF point)
 {
+    if (errorMetric == ErrorMetric::Sampson && ValidRegressionModel)
+    {
+        return EllipticalRegression::CalculateSampsonError(*this, point);
+    }
+
     return EllipticalRegression::CalculateError(*this, point);
 }
 
-RegressionModel::Summations* EllipticalRegression::EllipseModel::CalculateSummations(vector<PointF> points)
-{
-    EllipseSummations* sum = new EllipseSummations();
-    if (points.size() < MinimumPoints)
-    {
-        sum->N = 0;
-        return sum;
-    }
-
-    // Initialize all the summations to zero
-    sum->x = 0.0;
-    sum->y = 0.0;
-    sum->x2 = 0.0;
-    sum->y2 = 0.0;
-    sum->xy = 0.0;
-    sum->x3 = 0.0;
-    sum->y3 = 0.0;
-    sum->x2y = 0.0;  // (i.e.  SUM(x^2*y))
-    sum->xy2 = 0.0;
-    sum->x4 = 0.0;   // (i.e.  SUM(x^4))
-    sum->y4 = 0.0;
-    sum->x3y = 0.0;
-    sum->x2y2 = 0.0;
-    sum->xy3 = 0.0;
-
-    // Shorthand that better matches the math formulas
-    auto N = sum->N = (int)points.size();
-
-    // Calculate the summations
-    for (auto i = 0; i < N; ++i)
-    {
-        // Shorthand
-        auto x = points[i].X;
-        auto y = points[i].Y;
-        auto xx = x * x;
-        auto xy = x * y;
-        auto yy = y * y;
-
-        // Sums
-        sum->x += x;
-        sum->y += y;
-        sum->x2 += xx;
-        sum->y2 += yy;
-        sum->xy += xy;
-        sum->x3 += x * xx;
-        sum->y3 += y * yy;
-        sum->x2y += xx * y;
-        sum->xy2 += x * yy;
-        sum->x4 += xx * xx;
-        sum->y4 += yy * yy;
-        sum->x3y += xx * xy;
-        sum->x2y2 += xx * yy;
-        sum->xy3 += xy * yy;
-    }
-
-    return sum;
+// The ellipse errors are unsigned (see CalculateError), calculated without a virtual call per point
+void EllipticalRegression::EllipseModel::CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors)
+{
+    if (!ValidRegressionModel)
+    {
+        RegressionModel::CalculateSignedRegressionErrors(points, errors);
+        return;
+    }
+
+    double coefficients[] = { a, b, c, d, e, f };
+    if (errorMetric == ErrorMetric::Sampson)
+    {
+        // Capped as CalculateSampsonError caps it (a point at the center has no gradient)
+        SummationKernels::EllipseSampsonErrors(points.Xs(), points.Ys(), points.Count(), points.Stride(), coefficients, bias.x, bias.y, errors);
+        for (auto i = 0; i < points.Count(); ++i)
+        {
+            errors[i] = errors[i] < 99999999.9f ? errors[i] : 99999999.9f;
+        }
+        return;
+    }
+
+    // The min of the four distances of CalculateError in one branchless pass, with the coefficients read once
+    SummationKernels::EllipseErrors(points.Xs(), points.Ys(), points.Count(), points.Stride(), coefficients, bias.x, bias.y, errors);
+
+    // Points that cross no half of the ellipse (or whose distance is out of range) take CalculateError's fallback
+    for (auto i = 0; i < points.Count(); ++i)
+    {
+        if (!(errors[i] >= 0.0f && errors[i] < 99999999.9f))
+        {
+            errors[i] = EllipticalRegression::CalculateError(*this, points[i]);
+        }
+    }
+}
+
+void EllipticalRegression::EllipseModel::CalculateSummations(const PointCloud2D& points, Summations& sums)
+{
+    auto& sum = static_cast<EllipseSummations&>(sums);
+    if (points.Count() < MinimumPoints)
+    {
+        sum.N = 0;
+        return;
+    }
+
+    // M[i][j] = SUM(x^i * y^j) of the points with the model's bias removed, the same way UpdateSummations does
+    double M[5][5];
+    SummationKernels::EllipseSums(points.Xs(), points.Ys(), points.Count(), points.Stride(), (float)bias.x, (float)bias.y, M);
+
+    sum.N = points.Count();
+    sum.x = M[1][0];    sum.y = M[0][1];
+    sum.x2 = M[2][0];   sum.xy = M[1][1];   sum.y2 = M[0][2];
+    sum.x3 = M[3][0];   sum.x2y = M[2][1];  sum.xy2 = M[1][2];  sum.y3 = M[0][3];
+    sum.x4 = M[4][0];   sum.x3y = M[3][1];  sum.x2y2 = M[2][2]; sum.xy3 = M[1][3];  sum.y4 = M[0][4];
+    sum.factorized = false;
+}
+
+void EllipticalRegression::EllipseModel::UpdateSummations(Summations& sums, PointF point, double weight)
+{
+    EllipseSummations& sum = static_cast<EllipseSummations&>(sums);
+    if (!sum.factorized && sum.N >= MinimumPoints)
+    {
+        Factorize(sum);
+    }
+
+    // Remove the bias the same way the summations were calculated
+    auto x = (double)(point.X - (float)bias.x);
+    auto y = (double)(point.Y - (float)bias.y);
+    auto xx = x * x;
+    auto xy = x * y;
+    auto yy = y * y;
+
+    // Sums
+    sum.N += (int)weight;
+    sum.x += weight * x;
+    sum.y += weight * y;
+    sum.x2 += weight * xx;
+    sum.y2 += weight * yy;
+    sum.xy += weight * xy;
+    sum.x3 += weight * x * xx;
+    sum.y3 += weight * y * yy;
+    sum.x2y += weight * xx * y;
+    sum.xy2 += weight * x * yy;
+    sum.x4 += weight * xx * xx;
+    sum.y4 += weight * yy * yy;
+    sum.x3y += weight * xx * xy;
+    sum.x2y2 += weight * xx * yy;
+    sum.xy3 += weight * xy * yy;
+
+    if (sum.factorized)
+    {
+        double u[6];
+        Monomials(x, y, u);
+        UpdateInverse(sum, u, weight);
+    }
+}
+
+void EllipticalRegression::EllipseModel::Monomials(double x, double y, double u[6])
+{
+    u[0] = x * x;
+    u[1] = x * y;
+    u[2] = y * y;
+    u[3] = x;
+    u[4] = y;
+    u[5] = 1.0;
+}
+
+bool EllipticalRegression::EllipseModel::Factorize(EllipseSummations& sum)
+{
+    // G = [S X; X' N], the normal matrix of CalculateModel bordered by its right-hand side
+    Matrix<double, 6, 6> G;
+    G << sum.x4, sum.x3y, sum.x2y2, sum.x3, sum.x2y, sum.x2,
+        sum.x3y, sum.x2y2, sum.xy3, sum.x2y, sum.xy2, sum.xy,
+        sum.x2y2, sum.xy3, sum.y4, sum.xy2, sum.y3, sum.y2,
+        sum.x3, sum.x2y, sum.xy2, sum.x2, sum.xy, sum.x,
+        sum.x2y, sum.xy2, sum.y3, sum.xy, sum.y2, sum.y,
+        sum.x2, sum.xy, sum.y2, sum.x, sum.y, (double)sum.N;
+
+    // The same pivot check as CalculateModel, stricter since the updates amplify the rounding error.  The pivot 
+    // of the last row is the residual sum of squares, so an exact fit is not kept.
+    LDLT<Matrix<double, 6, 6>> ldlt(G);
+    Matrix<double, 6, 1> diagonal = ldlt.transpositionsP() * G.diagonal();
+    Matrix<double, 6, 1> pivots = ldlt.vectorD();
+    sum.factorized = ldlt.info() == Eigen::Success;
+    for (auto i = 0; i < 6; ++i)
+    {
+        sum.factorized = sum.factorized && pivots[i] > INVERSE_TOLERANCE * diagonal[i];
+    }
+
+    if (sum.factorized)
+    {
+        Matrix<double, 6, 6> inverse = ldlt.solve(Matrix<double, 6, 6>::Identity());
+        for (auto i = 0; i < 6; ++i)
+        {
+            for (auto j = 0; j < 6; ++j)
+            {
+                sum.inverse[i][j] = inverse(i, j);
+            }
+        }
+        sum.updates = 0;
+    }
+
+    return sum.factorized;
+}
+
+// INV(G + weight u u') = INV(G) - weight v v' / (1 + weight u'v),  v = INV(G) u  (Sherman-Morrison).  While the 
+// denominator stays away from zero G stays positive definite, and so does S within it.
+void EllipticalRegression::EllipseModel::UpdateInverse(EllipseSummations& sum, const double u[6], double weight)
+{
+    double v[6];
+    auto h = 0.0;
+    for (auto i = 0; i < 6; ++i)
+    {
+        v[i] = 0.0;
+        for (auto j = 0; j < 6; ++j)
+        {
+            v[i] += sum.inverse[i][j] * u[j];
+        }
+        h += u[i] * v[i];
+    }
+
+    // A removal of a point with a leverage near 1 leaves G (nearly) singular; invert it again at the next solve
+    auto denominator = 1.0 + weight * h;
+    if (denominator <= EPSILON || ++sum.updates > MAXIMUM_UPDATES)
+    {
+        sum.factorized = false;
+        return;
+    }
+
+    for (auto i = 0; i < 6; ++i)
+    {
+        for (auto j = 0; j < 6; ++j)
+        {
+            sum.inverse[i][j] -= weight * v[i] * v[j] / denominator;
+        }
+    }
+}
+
+// The monomials about the old center are those about the new center times P (x = x' + dx, y = y' + dy):
+//   u = P u'  so  G = P G' P'  and  INV(G') = P' INV(G) P
+void EllipticalRegression::EllipseModel::ShiftInverse(EllipseSummations& sum, double dx, double dy)
+{
+    const double P[6][6] = {
+        { 1, 0, 0, 2.0 * dx, 0, dx * dx },
+        { 0, 1, 0, dy, dx, dx * dy },
+        { 0, 0, 1, 0, 2.0 * dy, dy * dy },
+        { 0, 0, 0, 1, 0, dx },
+        { 0, 0, 0, 0, 1, dy },
+        { 0, 0, 0, 0, 0, 1 } };
+
+    double product[6][6] = {};      // INV(G) P
+    for (auto i = 0; i < 6; ++i)
+    {
+        for (auto k = 0; k < 6; ++k)
+        {
+            for (auto j = k; j < 6; ++j)
+            {
+                product[i][j] += sum.inverse[i][k] * P[k][j];
+            }
+        }
+    }
+
+    for (auto i = 0; i < 6; ++i)
+    {
+        for (auto j = 0; j < 6; ++j)
+        {
+            auto shifted = 0.0;
+            for (auto k = 0; k <= i; ++k)
+            {
+                shifted += P[k][i] * product[k][j];
+            }
+            sum.inverse[i][j] = shifted;
+        }
+    }
+}
+
+// The f = -1 constraint makes the ellipse fit depend on the origin, so keep the summations centered on the mean
+// of the remaining points as Recalculate would.  Each moment about the new center is a binomial expansion of
+// the moments about the old center:  SUM((x-dx)^i (y-dy)^j) = SUM_p SUM_q C(i,p) C(j,q) (-dx)^(i-p) (-dy)^(j-q) SUM(x^p y^q)
+void EllipticalRegression::EllipseModel::RecenterSummations(Summations& sums)
+{
+    EllipseSummations& sum = static_cast<EllipseSummations&>(sums);
+    if (sum.N <= 0)
+    {
+        return;
+    }
+
+    auto dx = sum.x / (double)sum.N;
+    auto dy = sum.y / (double)sum.N;
+    ShiftSummations(sum, dx, dy);
+
+    // Zero by construction
+    sum.x = 0.0;
+    sum.y = 0.0;
+
+    bias.x += dx;
+    bias.y += dy;
+}
+
+void EllipticalRegression::EllipseModel::ShiftSummations(Summations& sums, double dx, double dy)
+{
+    EllipseSummations& sum = static_cast<EllipseSummations&>(sums);
+
+    // M[i][j] = SUM(x^i * y^j) for i + j <= 4
+    double M[5][5] = {};
+    M[0][0] = sum.N;
+    M[1][0] = sum.x;    M[0][1] = sum.y;
+    M[2][0] = sum.x2;   M[1][1] = sum.xy;   M[0][2] = sum.y2;
+    M[3][0] = sum.x3;   M[2][1] = sum.x2y;  M[1][2] = sum.xy2;  M[0][3] = sum.y3;
+    M[4][0] = sum.x4;   M[3][1] = sum.x3y;  M[2][2] = sum.x2y2; M[1][3] = sum.xy3;  M[0][4] = sum.y4;
+
+    const double C[5][5] = { { 1 }, { 1, 1 }, { 1, 2, 1 }, { 1, 3, 3, 1 }, { 1, 4, 6, 4, 1 } };
+    double powX[5] = { 1.0 }, powY[5] = { 1.0 };
+    for (auto k = 1; k < 5; ++k)
+    {
+        powX[k] = powX[k - 1] * -dx;
+        powY[k] = powY[k - 1] * -dy;
+    }
+
+    double shifted[5][5] = {};
+    for (auto i = 0; i < 5; ++i)
+    {
+        for (auto j = 0; i + j < 5; ++j)
+        {
+            for (auto p = 0; p <= i; ++p)
+            {
+                for (auto q = 0; q <= j; ++q)
+                {
+                    shifted[i][j] += C[i][p] * C[j][q] * powX[i - p] * powY[j - q] * M[p][q];
+                }
+            }
+        }
+    }
+
+    sum.x = shifted[1][0];  sum.y = shifted[0][1];
+    sum.x2 = shifted[2][0]; sum.xy = shifted[1][1];  sum.y2 = shifted[0][2];
+    sum.x3 = shifted[3][0]; sum.x2y = shifted[2][1]; sum.xy2 = shifted[1][2];  sum.y3 = shifted[0][3];
+    sum.x4 = shifted[4][0]; sum.x3y = shifted[3][1]; sum.x2y2 = shifted[2][2]; sum.xy3 = shifted[1][3]; sum.y4 = shifted[0][4];
+
+    if (sum.factorized)
+    {
+        ShiftInverse(sum, dx, dy);
+    }
+}
+
+// With the kept inverse, the residual sum of squares after the update and the recentering of 
+// UpdatedResidualSumOfSquares is found without changing the summations.  About the mean m of the updated points 
+// the constraint f = -1 is the value of the conic at m, g'w = -1 for the conic w in this frame and 
+// g = [mx^2 mx*my my^2 mx my 1], so the minimum of w' G' w is  1 / (g' INV(G') g),  with INV(G') a rank-1 update.
+double EllipticalRegression::EllipseModel::CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight)
+{
+    EllipseSummations& sum = static_cast<EllipseSummations&>(sums);
+    if (!sum.factorized && (sum.N < MinimumPoints || !Factorize(sum)))
+    {
+        return UpdatedResidualSumOfSquares(*this, sum, point, weight);
+    }
+
+    auto N = sum.N + (int)weight;
+    if (N < MinimumPoints)
+    {
+        return 99999999.9;
+    }
+
+    // Remove the bias the same way the summations were calculated
+    auto x = (double)(point.X - (float)bias.x);
+    auto y = (double)(point.Y - (float)bias.y);
+
+    double u[6], g[6];
+    Monomials(x, y, u);
+    Monomials((sum.x + weight * x) / N, (sum.y + weight * y) / N, g);
+
+    // v = INV(G) u  and  w = INV(G) g
+    double v[6], w[6];
+    for (auto i = 0; i < 6; ++i)
+    {
+        v[i] = 0.0;
+        w[i] = 0.0;
+        for (auto j = 0; j < 6; ++j)
+        {
+            v[i] += sum.inverse[i][j] * u[j];
+            w[i] += sum.inverse[i][j] * g[j];
+        }
+    }
+
+    auto uv = 0.0, gv = 0.0, gw = 0.0;
+    for (auto i = 0; i < 6; ++i)
+    {
+        uv += u[i] * v[i];
+        gv += g[i] * v[i];
+        gw += g[i] * w[i];
+    }
+
+    // A removal that leaves G (nearly) singular is checked by the full update and solve, as UpdateInverse would
+    auto denominator = 1.0 + weight * uv;
+    if (denominator <= EPSILON)
+    {
+        return UpdatedResidualSumOfSquares(*this, sum, point, weight);
+    }
+
+    // g' INV(G') g
+    auto q = gw - weight * gv * gv / denominator;
+    if (q <= 0.0)
+    {
+        return 99999999.9;
+    }
+
+    return 1.0 / q;
+}
+
+// The O(1) residual sum of squares above for each point, with direct calls in the loop
+void EllipticalRegression::EllipseModel::CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask,
+    double weight, double* residualSumsOfSquares)
+{
+    for (auto i = 0; i < points.Count(); ++i)
+    {
+        residualSumsOfSquares[i] = mask[i] ? CalculateResidualSumOfSquares(sums, points[i], weight) : 99999999.9;
+    }
 }
 
 void EllipticalRegression::EllipseModel::CalculateModel(Summations& sums)
@@ -82,9 +392,29 @@ void EllipticalRegression::EllipseModel::CalculateModel(Summations& sums)
     // Calculate A = INV(X'X) * X 
     //     or    A = INV(S)   * X
 
-    MatrixXd S(5, 5);
-    VectorXd X(5);
-    VectorXd A(5);
+    Matrix5d S;
+    Vector5d X;
+    Vector5d A;
+
+    if (sum.factorized)
+    {
+        // The summations were only updated and shifted since G was inverted, so solve from the kept inverse:
+        //   A = -INV(G)[0..4][5] / INV(G)[5][5]  and  s = 1 / INV(G)[5][5]
+        auto q = sum.inverse[5][5];
+        if (q <= 0.0)
+        {
+            ValidRegressionModel = false;
+            return;
+        }
+
+        for (auto i = 0; i < 5; ++i)
+        {
+            A[i] = -sum.inverse[i][5] / q;
+        }
+        residualSumOfSquares = 1.0 / q;
+        SetCoefficients(A.data());
+        return;
+    }
     
     //Matrix<double> S = Matrix<double>.Build.Dense(5, 5);    // X'X
     //Vector<double> X = Vector<double>.Build.Dense(5);       // X' = [Sx2 Sxy Sy2 Sx Sy]
@@ -111,15 +441,32 @@ void EllipticalRegression::EllipseModel::CalculateModel(Summations& sums)
     S(4, 3) = S(3, 4) = sum.xy;
     S(4, 4) = sum.y2;
 
-    // Check for a singular matrix
-    if (abs(S.determinant()) <= EPSILON)
+    // One LDLT factorization both checks for a singular matrix and solves.  Each pivot is the part of its diagonal
+    // moment that the other moments do not explain, so relative to that moment it is independent of the scale 
+    // of the points (unlike det(S)).
+    LDLT<Matrix5d> ldlt(S);
+    Vector5d diagonal = ldlt.transpositionsP() * S.diagonal();
+    Vector5d pivots = ldlt.vectorD();
+    for (auto i = 0; i < 5; ++i)
     {
-        ValidRegressionModel = false;
-        return;
+        if (ldlt.info() != Eigen::Success || !(pivots[i] > PIVOT_TOLERANCE * diagonal[i]))
+        {
+            ValidRegressionModel = false;
+            return;
+        }
     }
 
-    A = S.inverse() * X;
+    A = ldlt.solve(X);
 
+    // The algebraic residual sum of squares, SUM((ax^2 + bxy + cy^2 + dx + ey - 1)^2) = N - A'X since S*A = X
+    residualSumOfSquares = max(0.0, sum.N - A.dot(X));
+
+    SetCoefficients(A.data());
+}
+
+// From the solution A = [a b c d e] of the normal equations
+void EllipticalRegression::EllipseModel::SetCoefficients(const double A[5])
+{
     // Calculate the coefficients of ax^2 + bxy + cy^2 + dx + ey + f = 0
     a = A[0];
     b = A[1];
@@ -210,7 +557,29 @@ float EllipticalRegression::EllipseConsensusModel::CalculateError(RegressionMode
         pointOnPositiveSide = false;
     }
 
-    return EllipticalRegression::CalculateError(model, point);
+    return model.CalculateRegressionError(point);
+}
+
+// The same error as CalculateError, taking the magnitude from the residuals cached when the model was scored
+void EllipticalRegression::EllipseConsensusModel::ScanCandidates(RegressionModel& modelr, int& positiveIndex, int& negativeIndex, int& influenceIndex)
+{
+    EllipseModel& model = static_cast<EllipseModel&>(modelr);
+    if (!ResidualsAvailable(model))
+    {
+        RegressionConsensusModel::ScanCandidates(modelr, positiveIndex, negativeIndex, influenceIndex);
+        return;
+    }
+
+    // The ellipse has no closed-form influence, so CooksDistance falls back to L2
+    RegressionConsensusModel::ScanCandidates(
+        [&](int i, PointF point, bool& pointOnPositiveSide)
+        {
+            auto whichSideOfEllipse = WhichSideOfEllipse(model, point);
+            pointOnPositiveSide = whichSideOfEllipse != SideOfEllipse::Inside;
+            return whichSideOfEllipse == SideOfEllipse::OnPerimeter ? 0.0f : abs(model.residuals[i]);
+        },
+        [&](int, PointF point) { return CalculateDistanceInfluence(influenceError, point, model); },
+        positiveIndex, negativeIndex, influenceIndex);
 }
 
 // Returns the real roots of the quadratic equation
@@ -243,7 +612,7 @@ void EllipticalRegression::QuadraticEquation(double a, double b, double c, int&
     }
 }
 
-EllipticalRegression::SideOfEllipse EllipticalRegression::WhichSideOfEllipse(EllipseModel ellipse, PointF point)
+EllipticalRegression::SideOfEllipse EllipticalRegression::WhichSideOfEllipse(const EllipseModel& ellipse, PointF point)
 {
     const double ON_PERIMETER_THRESHOLD = 0.0001;  // A high degree of precision is required to label a point on the perimeter
 
@@ -279,7 +648,7 @@ EllipticalRegression::SideOfEllipse EllipticalRegression::WhichSideOfEllipse(Ell
 }
 
 // Returns the modeled y-value of an ellipse
-float EllipticalRegression::ModeledY(EllipseModel model, float x_orig, EllipseHalves half)
+float EllipticalRegression::ModeledY(const EllipseModel& model, float x_orig, EllipseHalves half)
 {
     if (!model.ValidRegressionModel)
     {
@@ -324,7 +693,7 @@ float EllipticalRegression::ModeledY(EllipseModel model, float x_orig, EllipseHa
 }
 
 // Returns the modeled x-value of an ellipse
-float EllipticalRegression::ModeledX(EllipseModel model, float y_orig, EllipseHalves half)
+float EllipticalRegression::ModeledX(const EllipseModel& model, float y_orig, EllipseHalves half)
 {
     if (!model.ValidRegressionModel)
     {
@@ -370,7 +739,7 @@ float EllipticalRegression::ModeledX(EllipseModel model, float y_orig, EllipseHa
 
 float EllipticalRegression::CalculateError(RegressionModel& modelr, PointF point)
 {
-    EllipseModel& model = static_cast<EllipseModel&>(modelr);
+    const EllipseModel& model = static_cast<EllipseModel&>(modelr);
 
     auto x = point.X;
     auto y = point.Y;
@@ -397,14 +766,50 @@ float EllipticalRegression::CalculateError(RegressionModel& modelr, PointF point
     }
 }
 
-EllipticalRegression::EllipseConsensusModel& EllipticalRegression::CalculateEllipticalRegressionConsensus(vector<PointF> points, float sensitivity)
+// The Sampson distance of a point from the conic  Q(x, y) = a x^2 + b xy + c y^2 + d x + e y + f  (in the frame of 
+// the bias), |Q| / |grad Q|:  the distance to the curve to first order, exact on a straight line.  Unlike 
+// CalculateError it has no sentinel or fallback except at the center, where the gradient is zero.
+float EllipticalRegression::CalculateSampsonError(RegressionModel& modelr, PointF point)
 {
-    auto consensus = new EllipseConsensusModel();
+    EllipseModel& model = static_cast<EllipseModel&>(modelr);
+
+    auto x = point.X - model.bias.x;
+    auto y = point.Y - model.bias.y;
+
+    // Short-hand
+    auto a = model.a;
+    auto b = model.b;
+    auto c = model.c;
+    auto d = model.d;
+    auto e = model.e;
+    auto f = model.f;
+
+    // The operations (and their order) are those of SummationKernels::EllipseSampsonErrors
+    auto Q = a * x * x + b * x * y + c * y * y + d * x + e * y + f;
+    auto gradientX = 2.0 * a * x + b * y + d;
+    auto gradientY = b * x + 2.0 * c * y + e;
+    auto error = (float)(abs(Q) / sqrt(gradientX * gradientX + gradientY * gradientY));
+
+    return error < 99999999.9f ? error : 99999999.9f;
+}
+
+EllipticalRegression::EllipseConsensusModel& EllipticalRegression::CalculateEllipticalRegressionConsensus(const vector<PointF>& points, float sensitivity,
+    EllipseModel::ErrorMetric errorMetric)
+{
+    auto consensus = new EllipseConsensusModel(errorMetric);
     consensus->Calculate(points, sensitivity);
 
     return *consensus;
 }
 
+EllipticalRegression::EllipseConsensusModel& EllipticalRegression::CalculateEllipticalRegressionConsensus(const vector<PointF>& points, EllipseConsensusModel& prior, float sensitivity)
+{
+    auto consensus = new EllipseConsensusModel(static_cast<EllipseModel&>(*prior.model).errorMetric);
+    consensus->CalculateWarmStart(points, sensitivity, *prior.model, prior.inlierMask);
+
+    return *consensus;
+}
+
 EllipticalRegression::EllipseConsensusModel& EllipticalRegression::UnitTest1(vector<PointF>& points)
 {
     ///////////////////
@@ -573,4 +978,431 @@ EllipticalRegression::EllipseConsensusModel& EllipticalRegression::UnitTest6(vec
     points.push_back(PointF(0.63f, -2.5f));
 
     return CalculateEllipticalRegressionConsensus(points);
+}
+
+int EllipticalRegression::UnitTest7(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////
+    // Unit test #7:  Each limit returns its code and the best model   //
+    /////////////////////////////////////////////////////////////////////
+
+    // An ellipse x^2/400 + y^2/100 = 1 with 4 of its 15 points moved off of it.  With the exhaustive search the 
+    // average regression errors of the first removals are 2.143, 1.200, 1.245, ... since the search minimizes the 
+    // algebraic rather than the geometric error.  A limit after the second removal should return its code and 
+    // keep the model after the first removal, with its one outlier.
+
+    points = vector<PointF>();
+    points.push_back(PointF(20.00f, -9.00f));   // <--- Moved
+    points.push_back(PointF(18.27f, 10.07f));   // <--- Moved
+    points.push_back(PointF(4.38f, 7.43f));     // <--- Moved
+    points.push_back(PointF(6.18f, 17.51f));    // <--- Moved
+    points.push_back(PointF(-2.09f, 9.95f));
+    points.push_back(PointF(-11.00f, 8.66f));
+    points.push_back(PointF(-16.18f, 5.88f));
+    points.push_back(PointF(-19.56f, 2.08f));
+    points.push_back(PointF(-19.56f, -2.08f));
+    points.push_back(PointF(-16.18f, -5.88f));
+    points.push_back(PointF(-10.00f, -9.66f));
+    points.push_back(PointF(-2.09f, -9.95f));
+    points.push_back(PointF(6.18f, -9.51f));
+    points.push_back(PointF(13.38f, -7.43f));
+    points.push_back(PointF(18.27f, -4.07f));
+
+    for (auto limit = 0; limit < 3; ++limit)
+    {
+        EllipseConsensusModel consensus;
+        consensus.candidateSearch = RegressionConsensusModel::CandidateSearch::Exhaustive;
+        auto expectedStatus = RegressionConsensusModel::SUCCESS;
+        if (limit == 0)
+        {
+            consensus.maximumIterations = 2;
+            expectedStatus = RegressionConsensusModel::ITERATION_LIMIT;
+        }
+        else if (limit == 1)
+        {
+            consensus.maximumOutlierFraction = 2.0f / 15.0f;
+            expectedStatus = RegressionConsensusModel::OUTLIER_LIMIT;
+        }
+        else
+        {
+            // Reached before the first removal
+            consensus.deadlineMilliseconds = 0.000001;
+            expectedStatus = RegressionConsensusModel::DEADLINE_REACHED;
+        }
+
+        if (consensus.Calculate(points, DEFAULT_SENSITIVITY) != expectedStatus)
+        {
+            return 1;
+        }
+
+        // removalErrors holds the average regression error of the initial model and of each removal
+        auto bestError = *min_element(consensus.removalErrors.begin(), consensus.removalErrors.end());
+        if (consensus.model->AverageRegressionError != bestError)
+        {
+            return 2;
+        }
+
+        auto expectedOutliers = limit < 2 ? 1 : 0;
+        if ((int)consensus.outliers.size() != expectedOutliers || (int)consensus.inliers.size() != (int)points.size() - expectedOutliers)
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int EllipticalRegression::UnitTest8(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #8:  The batch Sampson errors match CalculateSampsonError    //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // A rotated ellipse centered at (500, 400) with radii 20 and 8, sampled at 37 points (not a multiple of the 
+    // vector width, so the scalar tail is checked as well) with some noise.  The Sampson error of every point 
+    // from the vectorized batch, and the average regression error, should match CalculateSampsonError applied 
+    // point by point.
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 37; ++i)
+    {
+        auto t = i * 2.0 * 3.14159265358979 / 37.0;
+        auto u = 20.0 * cos(t);
+        auto v = 8.0 * sin(t);
+        auto noise = (i % 5 - 2) * 0.1;
+        points.push_back(PointF((float)(500.0 + 0.8 * u - 0.6 * v + noise), (float)(400.0 + 0.6 * u + 0.8 * v - noise)));
+    }
+
+    EllipseModel ellipse;
+    ellipse.errorMetric = EllipseModel::ErrorMetric::Sampson;
+    RegressionModel& model = ellipse;
+    model.CalculateModel(points);
+    if (!model.ValidRegressionModel)
+    {
+        return 1;
+    }
+
+    auto errors = vector<float>(points.size());
+    model.CalculateSignedRegressionErrors(PointCloud2D::View(points), errors.data());
+
+    auto sumErrors = 0.0;
+    for (auto i = 0; i < (int)points.size(); ++i)
+    {
+        auto error = CalculateSampsonError(model, points[i]);
+        if (abs(errors[i] - error) > 0.000001f * max(1.0f, error))
+        {
+            return 2;
+        }
+        sumErrors += error;
+    }
+
+    if (abs(model.AverageRegressionError - sumErrors / points.size()) > 0.00001 * max(1.0, sumErrors / points.size()))
+    {
+        return 3;
+    }
+
+    return 0;
+}
+
+int EllipticalRegression::UnitTest9(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #9:  The batch axis distances match CalculateError           //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The ellipse of unit test #8, fit with the default axis distance metric, and four more points off it:  one 
+    // at the center, one below the ellipse that is within its x extent only, and two beyond both its x and y 
+    // extents that take CalculateError's fallback.  With each instruction set up to Supported(), the 
+    // error of every point from the vectorized batch, over the points themselves and over a view of them, should 
+    // match CalculateError applied point by point.
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 37; ++i)
+    {
+        auto t = i * 2.0 * 3.14159265358979 / 37.0;
+        auto u = 20.0 * cos(t);
+        auto v = 8.0 * sin(t);
+        auto noise = (i % 5 - 2) * 0.1;
+        points.push_back(PointF((float)(500.0 + 0.8 * u - 0.6 * v + noise), (float)(400.0 + 0.6 * u + 0.8 * v - noise)));
+    }
+
+    EllipseModel ellipse;
+    RegressionModel& model = ellipse;
+    model.CalculateModel(points);
+    if (!model.ValidRegressionModel)
+    {
+        return 1;
+    }
+
+    points.push_back(PointF(500.0f, 400.0f));
+    points.push_back(PointF(505.0f, 380.0f));
+    points.push_back(PointF(600.0f, 500.0f));
+    points.push_back(PointF(350.0f, 250.0f));
+
+    auto setting = SummationKernels::instructionSet;
+    auto result = 0;
+    auto owned = PointCloud2D(points);
+    auto view = PointCloud2D::View(points);
+    auto errors = vector<float>(points.size());
+    for (auto set = (int)SummationKernels::InstructionSet::Scalar; set <= (int)SummationKernels::Supported() && result == 0; ++set)
+    {
+        SummationKernels::instructionSet = (SummationKernels::InstructionSet)set;
+        for (auto cloud : { &owned, &view })
+        {
+            model.CalculateSignedRegressionErrors(*cloud, errors.data());
+            for (auto i = 0; i < (int)points.size(); ++i)
+            {
+                auto error = CalculateError(model, points[i]);
+                result = abs(errors[i] - error) <= 0.000001f * max(1.0f, error) ? result : 2;
+            }
+        }
+    }
+
+    SummationKernels::instructionSet = setting;
+    return result;
+}
+
+int EllipticalRegression::UnitTest10(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////////////
+    // Unit test #10:  Parallel candidate evaluation matches serial evaluation //
+    /////////////////////////////////////////////////////////////////////////////
+
+    // The ellipse of unit test #8 sampled at 3000 points with up to 0.2 of noise, where about 1 in 20 points is 
+    // moved out by as much as 10, so the inliers stay above parallelMinimumInliers and the candidates are refit 
+    // on separate threads.  With either refit method, the parallel evaluation should remove the same outliers in 
+    // the same order and end at exactly the same average regression error as the serial one.
+
+    srand(19);
+    points = vector<PointF>();
+    for (auto i = 0; i < 3000; ++i)
+    {
+        auto t = i * 2.0 * 3.14159265358979 / 3000.0;
+        auto scale = 1.0 + rand() % 100 / 5000.0;
+        if (rand() % 20 == 0)
+        {
+            scale += rand() % 100 / 200.0;
+        }
+        auto u = 20.0 * scale * cos(t);
+        auto v = 8.0 * scale * sin(t);
+        points.push_back(PointF((float)(500.0 + 0.8 * u - 0.6 * v), (float)(400.0 + 0.6 * u + 0.8 * v)));
+    }
+
+    const RegressionConsensusModel::RefitMethod refitMethods[] = { RegressionConsensusModel::RefitMethod::Recalculate, RegressionConsensusModel::RefitMethod::Downdate };
+    for (auto refitMethod : refitMethods)
+    {
+        EllipseConsensusModel serial;
+        serial.refitMethod = refitMethod;
+        serial.candidateEvaluation = RegressionConsensusModel::CandidateEvaluation::Serial;
+        auto status = serial.Calculate(points, DEFAULT_SENSITIVITY);
+
+        EllipseConsensusModel parallel;
+        parallel.refitMethod = refitMethod;
+        parallel.candidateEvaluation = RegressionConsensusModel::CandidateEvaluation::Parallel;
+        if (parallel.Calculate(points, DEFAULT_SENSITIVITY) != status || !parallel.model->ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        if (parallel.outlierIndices != serial.outlierIndices || parallel.numberOfInliers < parallel.parallelMinimumInliers)
+        {
+            return 2;
+        }
+
+        if (parallel.model->AverageRegressionError != serial.model->AverageRegressionError)
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int EllipticalRegression::UnitTest11(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #11:  Downdating labels the outliers Recalculate labels      //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The consensus on the points of each of the tests above, refit by downdating (and recentering) the 
+    // inliers' summations, should remove the same outliers in the same order as recalculating the bias and the 
+    // summations from the remaining points, and end at the same average regression error to rounding.
+
+    EllipseConsensusModel& (*tests[])(vector<PointF>&) = { UnitTest1, UnitTest2, UnitTest3, UnitTest4, UnitTest5, UnitTest6 };
+    for (auto test : tests)
+    {
+        test(points);
+
+        EllipseConsensusModel recalculated;
+        recalculated.refitMethod = RegressionConsensusModel::RefitMethod::Recalculate;
+        auto status = recalculated.Calculate(points, DEFAULT_SENSITIVITY);
+
+        EllipseConsensusModel downdated;
+        downdated.refitMethod = RegressionConsensusModel::RefitMethod::Downdate;
+        if (downdated.Calculate(points, DEFAULT_SENSITIVITY) != status || downdated.model->ValidRegressionModel != recalculated.model->ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        if (downdated.outlierIndices != recalculated.outlierIndices)
+        {
+            return 2;
+        }
+
+        if (abs(downdated.model->AverageRegressionError - recalculated.model->AverageRegressionError) > 0.0001f * max(1.0f, recalculated.model->AverageRegressionError))
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int EllipticalRegression::UnitTest12(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////////////////
+    // Unit test #12:  The O(1) residual sum of squares matches an explicit refit  //
+    /////////////////////////////////////////////////////////////////////////////////
+
+    // The ellipse of unit test #8 with one outlier.  The algebraic residual sum of squares that 
+    // CalculateResidualSumOfSquares finds from the kept inverse without each point, and with a point off the 
+    // ellipse added, should match that of an ellipse fit to those points from the start (about their own mean).
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 37; ++i)
+    {
+        auto t = i * 2.0 * 3.14159265358979 / 37.0;
+        auto u = 20.0 * cos(t);
+        auto v = 8.0 * sin(t);
+        auto noise = (i % 5 - 2) * 0.1;
+        points.push_back(PointF((float)(500.0 + 0.8 * u - 0.6 * v + noise), (float)(400.0 + 0.6 * u + 0.8 * v - noise)));
+    }
+    points[11].X += 3.0f;
+
+    EllipseModel ellipse;
+    RegressionModel& model = ellipse;
+    model.CalculateModel(points);
+    if (!model.ValidRegressionModel)
+    {
+        return 1;
+    }
+
+    for (auto i = 0; i <= (int)points.size(); ++i)
+    {
+        // The last pass adds a point instead of removing one
+        auto weight = i < (int)points.size() ? -1.0 : 1.0;
+        auto point = i < (int)points.size() ? points[i] : PointF(510.0f, 395.0f);
+        auto residualSumOfSquares = model.CalculateResidualSumOfSquares(model.ModelSummations(), point, weight);
+
+        auto refitPoints = points;
+        if (weight < 0.0)
+        {
+            refitPoints.erase(refitPoints.begin() + i);
+        }
+        else
+        {
+            refitPoints.push_back(point);
+        }
+
+        EllipseModel refit;
+        static_cast<RegressionModel&>(refit).CalculateModel(refitPoints);
+        if (abs(residualSumOfSquares - refit.residualSumOfSquares) > 0.001 * refit.residualSumOfSquares)
+        {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+int EllipticalRegression::UnitTest13(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////////
+    // Unit test #13:  Downdating past MAXIMUM_UPDATES matches a fresh solve      //
+    ////////////////////////////////////////////////////////////////////////////////
+
+    // The ellipse of unit test #8 sampled at 48 points.  Removing 40 of them one at a time from the summations 
+    // (spread around the ellipse) passes MAXIMUM_UPDATES, so the kept inverse is dropped and calculated again on 
+    // the way.  After each removal the downdated model should match an ellipse fit to the remaining points from 
+    // the start.  Then 12 points exactly on the ellipse and one outlier:  removing the outlier leaves an exact fit, 
+    // which the inverse cannot be kept for, and the downdated model should still match a fresh solve.
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 48; ++i)
+    {
+        auto t = i * 2.0 * 3.14159265358979 / 48.0;
+        auto u = 20.0 * cos(t);
+        auto v = 8.0 * sin(t);
+        auto noise = (i % 5 - 2) * 0.1;
+        points.push_back(PointF((float)(500.0 + 0.8 * u - 0.6 * v + noise), (float)(400.0 + 0.6 * u + 0.8 * v - noise)));
+    }
+
+    EllipseModel ellipse;
+    RegressionModel& model = ellipse;
+    model.CalculateModel(points);
+    auto& sum = model.ModelSummations();
+    auto removed = vector<bool>(points.size(), false);
+    for (auto k = 0; k < 40; ++k)
+    {
+        auto index = k * 7 % 48;
+        removed[index] = true;
+        model.UpdateSummations(sum, points[index], -1.0);
+        model.RecenterSummations(sum);
+
+        auto remaining = vector<PointF>();
+        for (auto i = 0; i < (int)points.size(); ++i)
+        {
+            if (!removed[i])
+            {
+                remaining.push_back(points[i]);
+            }
+        }
+
+        model.CalculateModel(sum, remaining);
+        EllipseModel fresh;
+        static_cast<RegressionModel&>(fresh).CalculateModel(remaining);
+        if (!model.ValidRegressionModel || !fresh.ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        if (abs(model.residualSumOfSquares - fresh.residualSumOfSquares) > 0.001 * fresh.residualSumOfSquares ||
+            abs(model.AverageRegressionError - fresh.AverageRegressionError) > 0.0001f * max(1.0f, fresh.AverageRegressionError))
+        {
+            return 2;
+        }
+    }
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 12; ++i)
+    {
+        auto t = i * 2.0 * 3.14159265358979 / 12.0;
+        auto u = 20.0 * cos(t);
+        auto v = 8.0 * sin(t);
+        points.push_back(PointF((float)(500.0 + 0.8 * u - 0.6 * v), (float)(400.0 + 0.6 * u + 0.8 * v)));
+    }
+    auto outlier = PointF(530.0f, 420.0f);
+    points.push_back(outlier);
+
+    EllipseModel exact;
+    RegressionModel& exactModel = exact;
+    exactModel.CalculateModel(points);
+    points.pop_back();
+    exactModel.UpdateSummations(exactModel.ModelSummations(), outlier, -1.0);
+    exactModel.RecenterSummations(exactModel.ModelSummations());
+    exactModel.CalculateModel(exactModel.ModelSummations(), points);
+
+    EllipseModel fresh;
+    static_cast<RegressionModel&>(fresh).CalculateModel(points);
+    if (!exactModel.ValidRegressionModel || !fresh.ValidRegressionModel)
+    {
+        return 3;
+    }
+
+    if (abs(exactModel.AverageRegressionError - fresh.AverageRegressionError) > 0.0001f)
+    {
+        return 4;
+    }
+
+    return 0;
 }
\ No newline at end of file
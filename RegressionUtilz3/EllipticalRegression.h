@@ -57,7 +57,7 @@ public:
         LeftHalf = 4
     };
 
-    class EllipseModel : public RegressionModel
+    class EllipseModel final : public RegressionModel
     {
     public:
         double a;
@@ -74,6 +74,13 @@ public:
         float long_axis;
         float short_axis;
 
+        enum class ErrorMetric
+        {
+            AxisDistance = 1,   // The nearest of the distances along x and along y to the ellipse (see CalculateError)
+            Sampson = 2,        // The first-order geometric distance |Q| / |grad Q| of the conic Q(x, y), one conic 
+        };                      //   evaluation per point and smooth near the ends of the axes (see CalculateSampsonError)
+        ErrorMetric errorMetric = ErrorMetric::AxisDistance;
+
     public:
         EllipseModel()
         {
@@ -110,6 +117,8 @@ public:
             radiusY = copy.radiusY;
             long_axis = copy.long_axis;
             short_axis = copy.short_axis;
+            errorMetric = copy.errorMetric;
+            summations = copy.summations;
         }
 
         RegressionModel* Clone() override
@@ -136,6 +145,8 @@ public:
             radiusY = other.radiusY;
             long_axis = other.long_axis;
             short_axis = other.short_axis;
+            errorMetric = other.errorMetric;
+            summations = other.summations;
 
             return *this;
         }
@@ -156,39 +167,107 @@ public:
             double x3y;
             double x2y2;
             double xy3;
+
+            // The inverse of the augmented moment matrix G = SUM(u u'), u = [x^2 xy y^2 x y 1], calculated when the 
+            // summations are first downdated and then kept through the rank-1 updates (Sherman-Morrison) and shifts 
+            // of the summations, so a refit without a point costs O(36) instead of a 5x5 solve.  Dropped after 
+            // MAXIMUM_UPDATES updates to bound the rounding error, and whenever the summations are calculated from 
+            // the points.
+            bool factorized;
+            int updates;                // Rank-1 updates since the inverse was calculated
+            double inverse[6][6];
+
+            EllipseSummations()
+            {
+                factorized = false;
+                updates = 0;
+            }
         };
+
+        const static int MAXIMUM_UPDATES = 32;
+        const static double PIVOT_TOLERANCE;        // The smallest LDLT pivot of S relative to its diagonal moment
+        const static double INVERSE_TOLERANCE;      // The same for G, to keep its inverse (a (nearly) exact fit does not)
+
+        EllipseSummations summations;
+
+        // u = [x^2 xy y^2 x y 1]
+        static void Monomials(double x, double y, double u[6]);
+
+        // Calculate the inverse of G from the summations.  Returns false (and no inverse) if G is near singular.
+        static bool Factorize(EllipseSummations& sum);
+
+        // Update the kept inverse for a point with monomials u added with the given weight (-1 removes it)
+        static void UpdateInverse(EllipseSummations& sum, const double u[6], double weight);
+
+        // Change the kept inverse to the frame shifted by (dx, dy), as ShiftSummations does the moments
+        static void ShiftInverse(EllipseSummations& sum, double dx, double dy);
         
     public:
         float CalculateRegressionError(PointF point) override;
 
-        Summations* CalculateSummations(vector<PointF> points) override;
+        void CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors) override;
+
+        void CalculateSummations(const PointCloud2D& points, Summations& sums) override;
+
+        Summations& ModelSummations() override
+        {
+            return summations;
+        }
+
+        void UpdateSummations(Summations& sums, PointF point, double weight) override;
+
+        void ShiftSummations(Summations& sums, double dx, double dy) override;
+
+        void RecenterSummations(Summations& sums) override;
+
+        double CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight) override;
+
+        void CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+            double* residualSumsOfSquares) override;
 
         void CalculateModel(Summations& sums) override;
 
         void CalculateFeatures() override;
+
+    protected:
+        void SetCoefficients(const double A[5]);
     };
 
     class EllipseConsensusModel : public RegressionConsensusModel
     {
     public:
-        EllipseConsensusModel() : RegressionConsensusModel()
+        EllipseConsensusModel(EllipseModel::ErrorMetric errorMetric = EllipseModel::ErrorMetric::AxisDistance) : RegressionConsensusModel()
         {
             influenceError = InfluenceError::L2;
-            model = new EllipseModel();
-            original = new EllipseModel();
+            auto ellipse = new EllipseModel();
+            ellipse->errorMetric = errorMetric;
+            model = ellipse;
+            original = new EllipseModel(*ellipse);
 
             inliers = vector<PointF>();
             outliers = vector<PointF>();
         }
 
-        EllipseConsensusModel(const EllipseConsensusModel& copy)
+        // Each consensus model owns (and deletes) its models, so a copy clones them
+        EllipseConsensusModel(const EllipseConsensusModel& copy) : RegressionConsensusModel()
         {
-            influenceError = copy.influenceError;
-            model = copy.model;
-            original = copy.original;
+            RegressionConsensusModel::operator=(copy);
+            model = copy.model->Clone();
+            original = copy.original->Clone();
+        }
+
+        EllipseConsensusModel& operator=(const EllipseConsensusModel& other)
+        {
+            if (this != &other)
+            {
+                delete model;
+                delete original;
 
-            inliers = copy.inliers;
-            outliers = copy.outliers;
+                RegressionConsensusModel::operator=(other);
+                model = other.model->Clone();
+                original = other.original->Clone();
+            }
+            return *this;
         }
 
         ~EllipseConsensusModel()
@@ -199,14 +278,24 @@ public:
 
     protected:
         float CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide) override;
+
+        void ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex) override;
     };
 
-    static EllipseConsensusModel& CalculateEllipticalRegressionConsensus(vector<PointF> points, float sensitivity = DEFAULT_SENSITIVITY);
+    // The sensitivity is in the units of the error metric.  The Sampson distance is close to the distance to the 
+    // nearest point of the ellipse, which is never more than the axis distance.
+    static EllipseConsensusModel& CalculateEllipticalRegressionConsensus(const vector<PointF>& points, float sensitivity = DEFAULT_SENSITIVITY,
+        EllipseModel::ErrorMetric errorMetric = EllipseModel::ErrorMetric::AxisDistance);
+
+    // Warm start from a prior consensus (e.g. of the previous frame), keeping its error metric.  If the prior labeled 
+    // as many points, its inlier labels are the starting inliers (the points are taken to be in the same order).
+    static EllipseConsensusModel& CalculateEllipticalRegressionConsensus(const vector<PointF>& points, EllipseConsensusModel& prior, float sensitivity = DEFAULT_SENSITIVITY);
     static void QuadraticEquation(double a, double b, double c, int& numberOfRoots, float& root1, float& root2);
-    static SideOfEllipse WhichSideOfEllipse(EllipseModel ellipse, PointF point);
-    static float ModeledY(EllipseModel model, float x_orig, EllipseHalves half = EllipseHalves::TopHalf);
-    static float ModeledX(EllipseModel model, float y_orig, EllipseHalves half = EllipseHalves::RightHalf);
+    static SideOfEllipse WhichSideOfEllipse(const EllipseModel& ellipse, PointF point);
+    static float ModeledY(const EllipseModel& model, float x_orig, EllipseHalves half = EllipseHalves::TopHalf);
+    static float ModeledX(const EllipseModel& model, float y_orig, EllipseHalves half = EllipseHalves::RightHalf);
     static float CalculateError(RegressionModel& model, PointF point);
+    static float CalculateSampsonError(RegressionModel& model, PointF point);
 
 public: // Unit tests
     static EllipseConsensusModel& UnitTest1(vector<PointF>& points);
@@ -215,4 +304,13 @@ public: // Unit tests
     static EllipseConsensusModel& UnitTest4(vector<PointF>& points);
     static EllipseConsensusModel& UnitTest5(vector<PointF>& points);
     static EllipseConsensusModel& UnitTest6(vector<PointF>& points);
+
+    // Checks that return 0 on success and non-zero on failure
+    static int UnitTest7(vector<PointF>& points);
+    static int UnitTest8(vector<PointF>& points);
+    static int UnitTest9(vector<PointF>& points);
+    static int UnitTest10(vector<PointF>& points);
+    static int UnitTest11(vector<PointF>& points);
+    static int UnitTest12(vector<PointF>& points);
+    static int UnitTest13(vector<PointF>& points);
 };
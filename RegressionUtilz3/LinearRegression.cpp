@@ -1,4 +1,7 @@
+#include <cmath>
+
 #include "LinearRegression.h"
+#include "SummationKernels.h"
 
 const float LinearRegression::DEFAULT_SENSITIVITY = 0.2f;
 
@@ -26,7 +29,29 @@ float LinearRegression::LineModel::ModeledX(float y)
     }
 }
 
-LinearRegression::LinearConsensusModel& LinearRegression::CalculateLinearRegressionConsensus(vector<PointF> points, PolynomialModel::enmIndependentVariable independentVariable, float sensitivity)
+// The modeled value minus the observed value of the dependent variable, as CalculateSignedRegressionError, in one 
+// loop with the axes swapped once for a y independent variable
+void LinearRegression::LineModel::CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors)
+{
+    if (!ValidRegressionModel)
+    {
+        RegressionModel::CalculateSignedRegressionErrors(points, errors);
+        return;
+    }
+
+    auto xIndependent = independentVariable == PolynomialModel::enmIndependentVariable::X;
+    auto xs = xIndependent ? points.Xs() : points.Ys();
+    auto ys = xIndependent ? points.Ys() : points.Xs();
+    auto stride = points.Stride();
+    auto N = points.Count();
+    for (auto i = 0; i < N; ++i)
+    {
+        auto x = xs[i * stride];
+        errors[i] = (float)(b1 + b2 * (double)x) - ys[i * stride];
+    }
+}
+
+LinearRegression::LinearConsensusModel& LinearRegression::CalculateLinearRegressionConsensus(const vector<PointF>& points, PolynomialModel::enmIndependentVariable independentVariable, float sensitivity)
 {
     auto consensus = new LinearConsensusModel(independentVariable);
     consensus->Calculate(points, sensitivity);
@@ -34,6 +59,14 @@ LinearRegression::LinearConsensusModel& LinearRegression::CalculateLinearRegress
     return *consensus;
 }
 
+LinearRegression::LinearConsensusModel& LinearRegression::CalculateLinearRegressionConsensus(const vector<PointF>& points, LinearConsensusModel& prior, float sensitivity)
+{
+    auto consensus = new LinearConsensusModel(static_cast<LineModel&>(*prior.model).independentVariable);
+    consensus->CalculateWarmStart(points, sensitivity, *prior.model, prior.inlierMask);
+
+    return *consensus;
+}
+
 float LinearRegression::LinearConsensusModel::CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide)
 {
     LineModel& line = static_cast<LineModel&>(model);
@@ -70,50 +103,112 @@ float LinearRegression::LinearConsensusModel::CalculateError(RegressionModel& mo
     }
 }
 
-RegressionModel::Summations* LinearRegression::LineModel::CalculateSummations(vector<PointF> points)
+// The same error as CalculateError from the residuals cached when the model was scored.  The cached residual is 
+// the modeled minus the observed value, so the perpendicular distance is |residual| / sqrt(b2^2 + 1) and the 
+// point is on the positive side when the residual is not positive.
+void LinearRegression::LinearConsensusModel::ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex)
 {
-    LinearSummations* sum = new LinearSummations();
-    if (points.size() < MinimumPoints)
+    LineModel& line = static_cast<LineModel&>(model);
+    if (!ResidualsAvailable(line))
     {
-        sum->N = 0;
-        return sum;
+        RegressionConsensusModel::ScanCandidates(model, positiveIndex, negativeIndex, influenceIndex);
+        return;
     }
 
-    // Initialize all the summations to zero
-    sum->x = 0.0;
-    sum->y = 0.0;
-    sum->x2 = 0.0;
-    sum->xy = 0.0;
+    auto denominator = sqrt(line.b2 * line.b2 + 1.0);
+    auto useCooksDistance = influenceError == InfluenceError::CooksDistance && CalculateCooksDistances(line);
 
-    // Shorthand that better matches the math formulas
-    auto N = sum->N = (int)points.size();
+    RegressionConsensusModel::ScanCandidates(
+        [&](int i, PointF point, bool& pointOnPositiveSide)
+        {
+            auto residual = line.residuals[i];
+            pointOnPositiveSide = !point.IsEmpty & (residual <= 0.0f);
+            return point.IsEmpty ? 999999999.9f : (float)(abs(residual) / denominator);
+        },
+        [&](int i, PointF point) { return useCooksDistance ? influences[i] : CalculateDistanceInfluence(influenceError, point, line); },
+        positiveIndex, negativeIndex, influenceIndex);
+}
 
-    // Calculate the summations
-    for (auto i = 0; i < N; ++i)
+void LinearRegression::LineModel::CalculateSummations(const PointCloud2D& points, Summations& sums)
+{
+    auto& sum = static_cast<LinearSummations&>(sums);
+    if (points.Count() < MinimumPoints)
     {
-        // Shorthand
-        auto x = points[i].X;
-        auto y = points[i].Y;
+        sum.N = 0;
+        return;
+    }
 
-        // Meh
-        if (independentVariable == PolynomialModel::enmIndependentVariable::Y)
-        {
-            // Swap the x and y coordinates to handle a y independent variable
-            x = points[i].Y;
-            y = points[i].X;
-        }
+    // The power sums of the points with the model's bias removed, the same way UpdateSummations does.  The x and 
+    // y arrays (and biases) swap to handle a y independent variable.
+    auto xIndependent = independentVariable == PolynomialModel::enmIndependentVariable::X;
+    auto xs = xIndependent ? points.Xs() : points.Ys();
+    auto ys = xIndependent ? points.Ys() : points.Xs();
+    auto biasX = (float)(xIndependent ? bias.x : bias.y);
+    auto biasY = (float)(xIndependent ? bias.y : bias.x);
+    double sumX[3];
+    double sumXY[2];
+    SummationKernels::PolynomialSums(xs, ys, points.Count(), points.Stride(), biasX, biasY, 1, sumX, sumXY, sum.y2);
+
+    sum.N = points.Count();
+    sum.x = sumX[1];
+    sum.x2 = sumX[2];
+    sum.y = sumXY[0];
+    sum.xy = sumXY[1];
+}
+
+void LinearRegression::LineModel::ShiftSummations(Summations& sums, double dx, double dy)
+{
+    LinearSummations& sum = static_cast<LinearSummations&>(sums);
+    if (independentVariable == PolynomialModel::enmIndependentVariable::Y)
+    {
+        // The summations are of the swapped coordinates
+        swap(dx, dy);
+    }
+
+    double sumX[] = { (double)sum.N, sum.x, sum.x2 };
+    double sumXY[] = { sum.y, sum.xy };
+    ShiftPowerSums(sumX, 2, sumXY, 1, sum.y2, dx, dy);
+    sum.x = sumX[1];
+    sum.x2 = sumX[2];
+    sum.y = sumXY[0];
+    sum.xy = sumXY[1];
+}
+
+void LinearRegression::LineModel::UpdateSummations(Summations& sums, PointF point, double weight)
+{
+    LinearSummations& sum = static_cast<LinearSummations&>(sums);
 
-        auto xx = x * x;
-        auto xy = x * y;
+    // Remove the bias the same way the summations were calculated
+    auto x = point.X - (float)bias.x;
+    auto y = point.Y - (float)bias.y;
 
-        // Sums
-        sum->x += x;
-        sum->y += y;
-        sum->x2 += xx;
-        sum->xy += xy;
+    if (independentVariable == PolynomialModel::enmIndependentVariable::Y)
+    {
+        // Swap the x and y coordinates to handle a y independent variable
+        swap(x, y);
     }
 
-    return sum;
+    auto xx = x * x;
+    auto xy = x * y;
+
+    // Sums
+    sum.N += (int)weight;
+    sum.x += weight * x;
+    sum.y += weight * y;
+    sum.x2 += weight * xx;
+    sum.xy += weight * xy;
+    sum.y2 += weight * y * y;
+}
+
+double LinearRegression::LineModel::CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight)
+{
+    return UpdatedResidualSumOfSquares(*this, static_cast<LinearSummations&>(sums), point, weight);
+}
+
+void LinearRegression::LineModel::CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+    double* residualSumsOfSquares)
+{
+    UpdatedResidualSumsOfSquares(*this, static_cast<LinearSummations&>(sums), points, mask, weight, residualSumsOfSquares);
 }
 
 void LinearRegression::LineModel::CalculateFeatures()
@@ -139,6 +234,7 @@ void LinearRegression::LineModel::CalculateModel(Summations& sums)
     // Calculate the S intermediate values
     auto s11 = sum.x2 - (1.0 / (double)sum.N) * sum.x * sum.x;
     auto sY1 = sum.xy - (1.0 / (double)sum.N) * sum.x * sum.y;
+    auto sYY = sum.y2 - (1.0 / (double)sum.N) * sum.y * sum.y;
 
     // Don't divide by zero
     // Note:  Maintaining the matrix notation even though S or s11 is a 1x1 "matrix".  For higher degrees, 
@@ -154,6 +250,16 @@ void LinearRegression::LineModel::CalculateModel(Summations& sums)
     b2 = sY1 / determinantS;
     b1 = YMean - b2 * XMean;
 
+    // The residual sum of squares, SUM((y - b1 - b2*x)^2) = sYY - b2*sY1
+    residualSumOfSquares = max(0.0, sYY - b2 * sY1);
+
+    // Keep the normal equations for the regression diagnostics
+    normalEquations.N = sum.N;
+    normalEquations.yMean = YMean;
+    normalEquations.powerMeans[0] = XMean;
+    normalEquations.coefficients[0] = b2;
+    normalEquations.inverseS[0][0] = 1.0 / determinantS;
+
     // Adjust for the bias
     if (independentVariable == PolynomialModel::enmIndependentVariable::X)
     {
@@ -393,6 +499,386 @@ LinearRegression::LinearConsensusModel& LinearRegression::UnitTest5(vector<Point
     return CalculateLinearRegressionConsensus(points);
 }
 
+vector<PointF> LinearRegression::ContaminatedLine(int count, float step, unsigned seed)
+{
+    srand(seed);
+    auto points = vector<PointF>();
+    for (auto i = 0; i < count; ++i)
+    {
+        auto x = i * step;
+        auto y = 2.0f * x + 1.0f + rand() % 100 / 500.0f;
+        if (rand() % 10 == 0)
+        {
+            y += rand() % 100 / 5.0f;
+        }
+        points.push_back(PointF(x, y));
+    }
+
+    return points;
+}
+
+int LinearRegression::UnitTest6(vector<PointF>& points)
+{
+    ///////////////////////////////////////////////////////////////////////
+    // Unit test #6:  Batch removal stops where single removal stops     //
+    ///////////////////////////////////////////////////////////////////////
+
+    // 3000 points along y = 2x + 1 with up to 0.2 of noise, where about 1 in 10 points is moved up by as much 
+    // as 20.  Batch removal should label about the same outliers as single removal and should not take the 
+    // average regression error far below the sensitivity.
+
+    points = ContaminatedLine(3000, 0.01f, 7);
+
+    LinearConsensusModel single(PolynomialModel::enmIndependentVariable::X);
+    single.removalMethod = RegressionConsensusModel::RemovalMethod::Single;
+    single.Calculate(points, DEFAULT_SENSITIVITY);
+
+    LinearConsensusModel batch(PolynomialModel::enmIndependentVariable::X);
+    batch.removalMethod = RegressionConsensusModel::RemovalMethod::Batch;
+    batch.Calculate(points, DEFAULT_SENSITIVITY);
+
+    if (!single.model->ValidRegressionModel || !batch.model->ValidRegressionModel)
+    {
+        return 1;
+    }
+
+    if (batch.model->AverageRegressionError > DEFAULT_SENSITIVITY || batch.model->AverageRegressionError < 0.9f * DEFAULT_SENSITIVITY)
+    {
+        return 2;
+    }
+
+    if (abs((int)batch.outliers.size() - (int)single.outliers.size()) > (int)single.outliers.size() / 20)
+    {
+        return 3;
+    }
+
+    return 0;
+}
+
+int LinearRegression::UnitTest7(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////////
+    // Unit test #7:  Requery of a recorded path matches a new Calculate   //
+    /////////////////////////////////////////////////////////////////////////
+
+    // 300 points along y = 2x + 1 where about 1 in 10 points is moved up by as much as 20.  Rewinding one 
+    // recorded removal path to each sensitivity should give what Calculate gives for that sensitivity.
+
+    points = ContaminatedLine(300, 0.1f, 11);
+
+    LinearConsensusModel recorded(PolynomialModel::enmIndependentVariable::X);
+    recorded.recordRemovalPath = true;
+    recorded.Calculate(points, DEFAULT_SENSITIVITY);
+
+    const float sensitivities[] = { 0.1f, 0.2f, 0.5f, 1.0f, 3.0f };
+    for (auto sensitivity : sensitivities)
+    {
+        LinearConsensusModel calculated(PolynomialModel::enmIndependentVariable::X);
+        if (recorded.Requery(sensitivity) != calculated.Calculate(points, sensitivity))
+        {
+            return 1;
+        }
+
+        if (recorded.outlierIndices != calculated.outlierIndices || recorded.inliers.size() != calculated.inliers.size())
+        {
+            return 2;
+        }
+
+        if (abs(recorded.model->AverageRegressionError - calculated.model->AverageRegressionError) > 0.0001f * max(1.0f, calculated.model->AverageRegressionError))
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int LinearRegression::UnitTest8(vector<PointF>& points)
+{
+    //////////////////////////////////////////////////////////////////////////////
+    // Unit test #8:  A warm start without a usable prior falls back to Calculate //
+    //////////////////////////////////////////////////////////////////////////////
+
+    // 300 points along y = 2x + 1 where about 1 in 10 points is moved up by as much as 20.  A warm start from a 
+    // prior that is not valid, or from a prior that none of the points fit, should give what Calculate gives.  
+    // A warm start from the consensus of the same points should still end at or below the sensitivity.  The same 
+    // points moved up by 5, as from one frame to the next, are beyond the admission error of the prior model, but 
+    // a warm start from the prior consensus begins with its inlier labels.  It should keep the prior inliers 
+    // within the sensitivity of the prior model, add none of the prior outliers, and not repeat the removals.
+
+    points = ContaminatedLine(300, 0.1f, 13);
+
+    LinearConsensusModel calculated(PolynomialModel::enmIndependentVariable::X);
+    auto status = calculated.Calculate(points, DEFAULT_SENSITIVITY);
+
+    // A prior that has not been calculated
+    LineModel invalidPrior(PolynomialModel::enmIndependentVariable::X);
+
+    // A prior 1000 above the points leaves too few of them within the admission error
+    auto farPoints = vector<PointF>();
+    farPoints.push_back(PointF(0.0f, 1001.0f));
+    farPoints.push_back(PointF(10.0f, 1021.0f));
+    farPoints.push_back(PointF(20.0f, 1041.0f));
+    LineModel farPrior(PolynomialModel::enmIndependentVariable::X);
+    static_cast<RegressionModel&>(farPrior).CalculateModel(farPoints);
+
+    RegressionModel* priors[] = { &invalidPrior, &farPrior };
+    for (auto prior : priors)
+    {
+        LinearConsensusModel warm(PolynomialModel::enmIndependentVariable::X);
+        if (warm.CalculateWarmStart(points, DEFAULT_SENSITIVITY, *prior) != status)
+        {
+            return 1;
+        }
+
+        if (warm.outlierIndices != calculated.outlierIndices || warm.model->AverageRegressionError != calculated.model->AverageRegressionError)
+        {
+            return 2;
+        }
+    }
+
+    LinearConsensusModel warm(PolynomialModel::enmIndependentVariable::X);
+    if (warm.CalculateWarmStart(points, DEFAULT_SENSITIVITY, *calculated.model) != RegressionConsensusModel::SUCCESS || warm.model->AverageRegressionError > DEFAULT_SENSITIVITY)
+    {
+        return 3;
+    }
+
+    auto shifted = points;
+    for (auto& point : shifted)
+    {
+        point.Y += 5.0f;
+    }
+
+    auto& tracked = CalculateLinearRegressionConsensus(shifted, calculated);
+    if (!tracked.model->ValidRegressionModel || tracked.model->AverageRegressionError > DEFAULT_SENSITIVITY)
+    {
+        return 4;
+    }
+
+    for (auto i = 0; i < (int)points.size(); ++i)
+    {
+        auto fitsPrior = calculated.inlierMask[i] && calculated.model->CalculateRegressionError(points[i]) <= DEFAULT_SENSITIVITY;
+        if ((fitsPrior && !tracked.inlierMask[i]) || (!calculated.inlierMask[i] && tracked.inlierMask[i]))
+        {
+            return 4;
+        }
+    }
+
+    if (tracked.removalErrors.size() >= calculated.removalErrors.size())
+    {
+        return 5;
+    }
+
+    return 0;
+}
+
+int LinearRegression::UnitTest9(vector<PointF>& points)
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Unit test #9:  Re-admission adds back the line points a batch removed //
+    //////////////////////////////////////////////////////////////////////////
+
+    // A line y = x with a cluster of 6 outliers near its end at x = 19.  The cluster pulls the initial model up 
+    // at that end, so the batch also removes the line points (18, 18) and (19, 19).  They fit the final model, 
+    // so re-admission should add them back and leave only the cluster as outliers.
+
+    points = vector<PointF>();
+    points.push_back(PointF(0.00f, 0.00f));
+    points.push_back(PointF(1.00f, 1.10f));
+    points.push_back(PointF(2.00f, 1.90f));
+    points.push_back(PointF(3.00f, 3.10f));
+    points.push_back(PointF(4.00f, 4.00f));
+    points.push_back(PointF(5.00f, 4.90f));
+    points.push_back(PointF(6.00f, 6.00f));
+    points.push_back(PointF(7.00f, 7.10f));
+    points.push_back(PointF(8.00f, 7.95f));
+    points.push_back(PointF(9.00f, 8.90f));
+    points.push_back(PointF(10.00f, 9.95f));
+    points.push_back(PointF(11.00f, 11.00f));
+    points.push_back(PointF(12.00f, 12.05f));
+    points.push_back(PointF(13.00f, 12.95f));
+    points.push_back(PointF(14.00f, 14.10f));
+    points.push_back(PointF(15.00f, 14.90f));
+    points.push_back(PointF(16.00f, 16.10f));
+    points.push_back(PointF(17.00f, 17.10f));
+    points.push_back(PointF(18.00f, 18.00f));
+    points.push_back(PointF(19.00f, 19.00f));
+    points.push_back(PointF(19.20f, 32.30f));   // <--- Cluster of outliers
+    points.push_back(PointF(19.70f, 32.30f));   // <--- Cluster of outliers
+    points.push_back(PointF(19.00f, 32.80f));   // <--- Cluster of outliers
+    points.push_back(PointF(19.50f, 32.60f));   // <--- Cluster of outliers
+    points.push_back(PointF(19.20f, 32.70f));   // <--- Cluster of outliers
+    points.push_back(PointF(19.80f, 32.10f));   // <--- Cluster of outliers
+
+    LinearConsensusModel removed(PolynomialModel::enmIndependentVariable::X);
+    removed.removalMethod = RegressionConsensusModel::RemovalMethod::Batch;
+    removed.Calculate(points, DEFAULT_SENSITIVITY);
+
+    LinearConsensusModel readmitted(PolynomialModel::enmIndependentVariable::X);
+    readmitted.removalMethod = RegressionConsensusModel::RemovalMethod::Batch;
+    readmitted.readmitOutliers = true;
+    if (readmitted.Calculate(points, DEFAULT_SENSITIVITY) != RegressionConsensusModel::SUCCESS || readmitted.model->AverageRegressionError > DEFAULT_SENSITIVITY)
+    {
+        return 1;
+    }
+
+    if (readmitted.outliers.size() != 6 || removed.outliers.size() <= readmitted.outliers.size())
+    {
+        return 2;
+    }
+
+    for (auto& outlier : readmitted.outliers)
+    {
+        if (outlier.Y < 30.0f)
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int LinearRegression::UnitTest10(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////////////
+    // Unit test #10:  Parallel candidate evaluation matches serial evaluation //
+    /////////////////////////////////////////////////////////////////////////////
+
+    // 4000 points along y = 2x + 1 where about 1 in 10 points is moved up by as much as 20, so the inliers stay 
+    // above parallelMinimumInliers and the candidates are refit on separate threads.  With either refit method, 
+    // the parallel evaluation should remove the same outliers in the same order and end at exactly the same 
+    // average regression error as the serial one.
+
+    points = ContaminatedLine(4000, 0.01f, 17);
+
+    const RegressionConsensusModel::RefitMethod refitMethods[] = { RegressionConsensusModel::RefitMethod::Recalculate, RegressionConsensusModel::RefitMethod::Downdate };
+    for (auto refitMethod : refitMethods)
+    {
+        LinearConsensusModel serial(PolynomialModel::enmIndependentVariable::X);
+        serial.refitMethod = refitMethod;
+        serial.candidateEvaluation = RegressionConsensusModel::CandidateEvaluation::Serial;
+        auto status = serial.Calculate(points, DEFAULT_SENSITIVITY);
+
+        LinearConsensusModel parallel(PolynomialModel::enmIndependentVariable::X);
+        parallel.refitMethod = refitMethod;
+        parallel.candidateEvaluation = RegressionConsensusModel::CandidateEvaluation::Parallel;
+        if (parallel.Calculate(points, DEFAULT_SENSITIVITY) != status || !parallel.model->ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        if (parallel.outlierIndices != serial.outlierIndices || parallel.numberOfInliers < parallel.parallelMinimumInliers)
+        {
+            return 2;
+        }
+
+        if (parallel.model->AverageRegressionError != serial.model->AverageRegressionError)
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int LinearRegression::UnitTest11(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #11:  Downdating labels the outliers Recalculate labels      //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The consensus on the points of each of the tests above, refit by downdating the inliers' summations, 
+    // should remove the same outliers in the same order as recalculating the summations from the remaining 
+    // points, and end at the same average regression error to rounding.  Anscombe's second set is a parabola 
+    // nearly symmetric about its vertex, so the candidates on either side of it nearly tie and rounding picks 
+    // the side; there the two should only remove as many points.  Anscombe's fourth set leaves every x at 8 
+    // once its outlier is removed, so its errors agree only to 0.001.
+
+    LinearConsensusModel& (*tests[])(vector<PointF>&) = { UnitTestA1, UnitTestA2, UnitTestA3, UnitTestA4, UnitTest1, UnitTest2,
+        UnitTest3, UnitTest4, UnitTest5 };
+    for (auto test : tests)
+    {
+        auto independentVariable = static_cast<LineModel&>(*test(points).model).independentVariable;
+
+        LinearConsensusModel recalculated(independentVariable);
+        recalculated.refitMethod = RegressionConsensusModel::RefitMethod::Recalculate;
+        auto status = recalculated.Calculate(points, DEFAULT_SENSITIVITY);
+
+        LinearConsensusModel downdated(independentVariable);
+        downdated.refitMethod = RegressionConsensusModel::RefitMethod::Downdate;
+        if (downdated.Calculate(points, DEFAULT_SENSITIVITY) != status || downdated.model->ValidRegressionModel != recalculated.model->ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        auto tied = test == UnitTestA2;
+        if (downdated.outlierIndices.size() != recalculated.outlierIndices.size() || (!tied && downdated.outlierIndices != recalculated.outlierIndices))
+        {
+            return 2;
+        }
+
+        if (abs(downdated.model->AverageRegressionError - recalculated.model->AverageRegressionError) > 0.001f * max(1.0f, recalculated.model->AverageRegressionError))
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+int LinearRegression::UnitTest12(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////////////////
+    // Unit test #12:  The O(1) residual sum of squares matches an explicit refit  //
+    /////////////////////////////////////////////////////////////////////////////////
+
+    // 30 points along y = 2x + 1 with some noise and one outlier.  The residual sum of squares that 
+    // CalculateResidualSumOfSquares finds from the summations without each point, and with a point off the 
+    // line added, should match that of a line fit to those points from the start.
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 30; ++i)
+    {
+        points.push_back(PointF(i * 0.5f, 2.0f * i * 0.5f + 1.0f + (i % 5 - 2) * 0.1f));
+    }
+    points[17].Y += 3.0f;
+
+    LineModel line(PolynomialModel::enmIndependentVariable::X);
+    RegressionModel& model = line;
+    model.CalculateModel(points);
+    if (!model.ValidRegressionModel)
+    {
+        return 1;
+    }
+
+    for (auto i = 0; i <= (int)points.size(); ++i)
+    {
+        // The last pass adds a point instead of removing one
+        auto weight = i < (int)points.size() ? -1.0 : 1.0;
+        auto point = i < (int)points.size() ? points[i] : PointF(4.0f, 15.0f);
+        auto residualSumOfSquares = model.CalculateResidualSumOfSquares(model.ModelSummations(), point, weight);
+
+        auto refitPoints = points;
+        if (weight < 0.0)
+        {
+            refitPoints.erase(refitPoints.begin() + i);
+        }
+        else
+        {
+            refitPoints.push_back(point);
+        }
+
+        LineModel refit(PolynomialModel::enmIndependentVariable::X);
+        static_cast<RegressionModel&>(refit).CalculateModel(refitPoints);
+        if (abs(residualSumOfSquares - refit.residualSumOfSquares) > 0.0001 * max(1.0, refit.residualSumOfSquares))
+        {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
 //int main(int argc, char** argv)
 //{
 //    vector<PointF> points, outliers;
@@ -36,7 +36,7 @@ protected:
     const static float DEFAULT_SENSITIVITY;
 
 public:
-    class LineModel : public PolynomialModel
+    class LineModel final : public PolynomialModel
     {
     public:
         double slope;
@@ -64,6 +64,7 @@ public:
             intercept = copy.intercept;
             b1 = copy.b1;
             b2 = copy.b2;
+            summations = copy.summations;
         }
 
         RegressionModel* Clone() override
@@ -80,6 +81,7 @@ public:
             intercept = other.intercept;
             b1 = other.b1;
             b2 = other.b2;
+            summations = other.summations;
 
             return *this;
         }
@@ -88,16 +90,35 @@ public:
 
         float ModeledX(float y) override;
 
+        void CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors) override;
+
     protected:
         class LinearSummations : public Summations
         {
         public:
             double x2;
             double xy;
+            double y2;
         };
 
+        LinearSummations summations;
+
     public:
-        Summations* CalculateSummations(vector<PointF> points) override;
+        void CalculateSummations(const PointCloud2D& points, Summations& sums) override;
+
+        Summations& ModelSummations() override
+        {
+            return summations;
+        }
+
+        void UpdateSummations(Summations& sums, PointF point, double weight) override;
+
+        void ShiftSummations(Summations& sums, double dx, double dy) override;
+
+        double CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight) override;
+
+        void CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+            double* residualSumsOfSquares) override;
 
         void CalculateModel(Summations& sums) override;
 
@@ -116,9 +137,25 @@ public:
             outliers = vector<PointF>();
         }
 
+        // Each consensus model owns (and deletes) its models, so a copy clones them
+        LinearConsensusModel(const LinearConsensusModel& copy) : RegressionConsensusModel()
+        {
+            RegressionConsensusModel::operator=(copy);
+            model = copy.model->Clone();
+            original = copy.original->Clone();
+        }
+
         LinearConsensusModel& operator=(const LinearConsensusModel& other)
         {
-            RegressionConsensusModel::operator=(other);
+            if (this != &other)
+            {
+                delete model;
+                delete original;
+
+                RegressionConsensusModel::operator=(other);
+                model = other.model->Clone();
+                original = other.original->Clone();
+            }
             return *this;
         }
 
@@ -130,9 +167,15 @@ public:
 
     protected:
         float CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide) override;
+
+        void ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex) override;
     };
 
-    static LinearConsensusModel& CalculateLinearRegressionConsensus(vector<PointF> points, PolynomialModel::enmIndependentVariable independentVariable = PolynomialModel::enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY);
+    static LinearConsensusModel& CalculateLinearRegressionConsensus(const vector<PointF>& points, PolynomialModel::enmIndependentVariable independentVariable = PolynomialModel::enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY);
+
+    // Warm start from a prior consensus (e.g. of the previous frame), keeping its independent variable.  If the prior labeled 
+    // as many points, its inlier labels are the starting inliers (the points are taken to be in the same order).
+    static LinearConsensusModel& CalculateLinearRegressionConsensus(const vector<PointF>& points, LinearConsensusModel& prior, float sensitivityInPixels = DEFAULT_SENSITIVITY);
 
 public: // Unit tests
     static LinearConsensusModel& UnitTestA1(vector<PointF>& anscombe1);
@@ -145,4 +188,17 @@ public: // Unit tests
     static LinearConsensusModel& UnitTest4(vector<PointF>& anscombe1);
     static LinearConsensusModel& UnitTest5(vector<PointF>& anscombe1);
 
+    // Checks that return 0 on success and non-zero on failure
+    static int UnitTest6(vector<PointF>& points);
+    static int UnitTest7(vector<PointF>& points);
+    static int UnitTest8(vector<PointF>& points);
+    static int UnitTest9(vector<PointF>& points);
+    static int UnitTest10(vector<PointF>& points);
+    static int UnitTest11(vector<PointF>& points);
+    static int UnitTest12(vector<PointF>& points);
+
+private:
+    // count points along y = 2x + 1 at x = i * step with up to 0.2 of noise, where about 1 in 10 points is moved 
+    // up by as much as 20.  The same seed gives the same points.
+    static vector<PointF> ContaminatedLine(int count, float step, unsigned seed);
 };
@@ -0,0 +1,197 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "PointCloud2D.h"
+
+static_assert(offsetof(PointF, X) == 0 && offsetof(PointF, Y) == sizeof(float) && sizeof(PointF) == 3 * sizeof(float),
+    "A view of PointF steps from one point's X (or Y) to the next in 3 floats");
+
+PointCloud2D::PointCloud2D()
+{
+    count = 0;
+    stride = 1;
+    xs = nullptr;
+    ys = nullptr;
+    source = nullptr;
+}
+
+PointCloud2D::PointCloud2D(const vector<PointF>& points)
+    : PointCloud2D()
+{
+    auto x = Allocate((int)points.size());
+    auto y = x + (ys - xs);
+    auto allValid = true;
+    for (auto i = 0; i < count; ++i)
+    {
+        x[i] = points[i].X;
+        y[i] = points[i].Y;
+        allValid &= !points[i].IsEmpty;
+    }
+
+    // Only keep a validity mask if some point is empty
+    if (!allValid)
+    {
+        validity.assign((count + 63) / 64, 0);
+        for (auto i = 0; i < count; ++i)
+        {
+            validity[i >> 6] |= (unsigned long long)!points[i].IsEmpty << (i & 63);
+        }
+    }
+}
+
+PointCloud2D::PointCloud2D(const float* x, const float* y, int count)
+    : PointCloud2D()
+{
+    auto ownX = Allocate(count);
+    auto ownY = ownX + (ys - xs);
+    copy(x, x + count, ownX);
+    copy(y, y + count, ownY);
+}
+
+PointCloud2D::PointCloud2D(const PointCloud2D& copy)
+    : PointCloud2D()
+{
+    *this = copy;
+}
+
+PointCloud2D& PointCloud2D::operator=(const PointCloud2D& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    validity = other.validity;
+    if (other.source != nullptr || other.count == 0)
+    {
+        // A view shares the viewed points
+        storage = vector<float>();
+        count = other.count;
+        stride = other.stride;
+        xs = other.xs;
+        ys = other.ys;
+        source = other.source;
+        return *this;
+    }
+
+    // The alignment of a copied vector may differ, so re-align and copy the coordinates
+    source = nullptr;
+    auto x = Allocate(other.count);
+    auto y = x + (ys - xs);
+    std::copy(other.xs, other.xs + count, x);
+    std::copy(other.ys, other.ys + count, y);
+
+    return *this;
+}
+
+void PointCloud2D::Assign(const PointCloud2D& points)
+{
+    Assign(points, vector<unsigned char>());
+}
+
+void PointCloud2D::Assign(const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex)
+{
+    if (&points == this)
+    {
+        if (source == nullptr && mask.empty() && excludedIndex < 0)
+        {
+            // Already owned and nothing is left out
+            return;
+        }
+
+        // Allocate would overwrite the points before they are read, so gather into a new cloud and copy it in
+        PointCloud2D gathered;
+        gathered.Assign(points, mask, excludedIndex);
+        *this = gathered;
+        return;
+    }
+
+    auto keep = [&](int i) { return (mask.empty() || mask[i]) && i != excludedIndex; };
+    auto kept = 0;
+    for (auto i = 0; i < points.count; ++i)
+    {
+        kept += keep(i);
+    }
+
+    source = nullptr;
+    validity.clear();
+    auto x = Allocate(kept);
+    auto y = x + (ys - xs);
+    auto j = 0;
+    for (auto i = 0; i < points.count; ++i)
+    {
+        if (!keep(i))
+        {
+            continue;
+        }
+
+        x[j] = points.X(i);
+        y[j] = points.Y(i);
+
+        // Only keep a validity mask if some point is not valid
+        if (!points.IsValid(i))
+        {
+            if (validity.empty())
+            {
+                validity.assign((kept + 63) / 64, ~0ULL);
+            }
+            validity[j >> 6] &= ~(1ULL << (j & 63));
+        }
+        ++j;
+    }
+}
+
+PointCloud2D PointCloud2D::View(const PointF* points, int count)
+{
+    PointCloud2D view;
+    view.count = count;
+    if (count > 0)
+    {
+        view.stride = (int)(sizeof(PointF) / sizeof(float));
+        view.xs = &points[0].X;
+        view.ys = &points[0].Y;
+        view.source = points;
+    }
+
+    return view;
+}
+
+PointCloud2D PointCloud2D::View(const vector<PointF>& points)
+{
+    return View(points.data(), (int)points.size());
+}
+
+vector<PointF> PointCloud2D::ToPoints() const
+{
+    if (source != nullptr)
+    {
+        return vector<PointF>(source, source + count);
+    }
+
+    auto points = vector<PointF>();
+    points.reserve(count);
+    for (auto i = 0; i < count; ++i)
+    {
+        points.push_back((*this)[i]);
+    }
+
+    return points;
+}
+
+float* PointCloud2D::Allocate(int count)
+{
+    const int FLOATS_PER_ALIGNMENT = ALIGNMENT / (int)sizeof(float);
+
+    // Pad each array to a whole number of alignments, plus one alignment of slack to align the start
+    auto padded = (count + FLOATS_PER_ALIGNMENT - 1) / FLOATS_PER_ALIGNMENT * FLOATS_PER_ALIGNMENT;
+    storage.assign(2 * padded + FLOATS_PER_ALIGNMENT, 0.0f);
+    auto offset = (ALIGNMENT - (int)((uintptr_t)storage.data() % ALIGNMENT)) % ALIGNMENT / (int)sizeof(float);
+
+    auto x = storage.data() + offset;
+    this->count = count;
+    stride = 1;
+    xs = x;
+    ys = x + padded;
+
+    return x;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+
+#include "PointF.cpp"
+
+using namespace std;
+
+/// <summary>
+/// PointCloud2D
+/// Description:  A read-only set of 2D points laid out for the fitting kernels, with the x-coordinates and the
+///   y-coordinates in separate contiguous arrays (structure of arrays) and the validity of the points in an
+///   optional bitmask instead of a bool in every point.
+///
+///   A PointCloud2D either owns its arrays, each aligned to ALIGNMENT bytes for vector loads, or is a view
+///   (View) that reads an existing array of PointF in place through a stride, without copying it.  The models
+///   read points only through X(i), Y(i), and IsValid(i), so both kinds are accepted everywhere.
+/// </summary>
+///
+class PointCloud2D
+{
+public:
+    const static int ALIGNMENT = 64;        // Bytes, a cache line (enough for AVX-512 loads)
+
+    PointCloud2D();
+
+    // Copy the points into owned, aligned arrays (an empty PointF becomes an invalid point)
+    PointCloud2D(const vector<PointF>& points);
+
+    // Copy count coordinates into owned, aligned arrays.  All the points are valid.
+    PointCloud2D(const float* x, const float* y, int count);
+
+    PointCloud2D(const PointCloud2D& copy);
+
+    PointCloud2D& operator=(const PointCloud2D& other);
+
+    // Copy the points into this cloud's owned arrays (stride 1), reusing its storage.  Unlike operator=, a view 
+    // is copied rather than shared.  The points may be this cloud itself.
+    void Assign(const PointCloud2D& points);
+
+    // As above, copying only the points whose mask is set and leaving out the excluded index (if any)
+    void Assign(const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex = -1);
+
+    // A view of count points read in place.  The points must outlive the view.  A view assumes PointF is laid out 
+    // as X, Y, then IsEmpty padded to a float, so that the x-coordinates (and the y-coordinates) are 3 floats 
+    // apart; PointCloud2D.cpp checks this with a static_assert.
+    static PointCloud2D View(const PointF* points, int count);
+    static PointCloud2D View(const vector<PointF>& points);
+
+    int Count() const
+    {
+        return count;
+    }
+
+    // The number of floats from one coordinate to the next: 1 for owned arrays, 3 for a view of PointF
+    int Stride() const
+    {
+        return stride;
+    }
+
+    const float* Xs() const
+    {
+        return xs;
+    }
+
+    const float* Ys() const
+    {
+        return ys;
+    }
+
+    float X(int i) const
+    {
+        return xs[i * stride];
+    }
+
+    float Y(int i) const
+    {
+        return ys[i * stride];
+    }
+
+    bool IsValid(int i) const
+    {
+        if (source != nullptr)
+        {
+            return !source[i].IsEmpty;
+        }
+
+        return validity.empty() || ((validity[i >> 6] >> (i & 63)) & 1) != 0;
+    }
+
+    PointF operator[](int i) const
+    {
+        PointF point(X(i), Y(i));
+        point.IsEmpty = !IsValid(i);
+        return point;
+    }
+
+    // Copy the points back out as PointF
+    vector<PointF> ToPoints() const;
+
+private:
+    int count;
+    int stride;
+    const float* xs;
+    const float* ys;
+
+    const PointF* source;                   // The points of a view, whose IsEmpty is their validity (or nullptr)
+    vector<float> storage;                  // The owned x-array then y-array, each starting on an ALIGNMENT boundary
+    vector<unsigned long long> validity;    // Bit i is set if point i is valid (empty if all the points are valid)
+
+    // Size the owned storage for count points and point xs and ys into it
+    float* Allocate(int count);
+};
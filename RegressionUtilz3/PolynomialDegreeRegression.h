@@ -0,0 +1,549 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#include "PolynomialRegression.h"
+#include "RegressionConsensusModel.h"
+#include "SummationKernels.h"
+
+using namespace std;
+
+/// <summary>
+/// PolynomialDegreeRegression
+/// Description:  The polynomial regression of any degree D from 1 to PolynomialModel::MAXIMUM_DEGREE, fixed at
+///   compile time, e.g. PolynomialDegreeRegression<6> for a profile that a cubic cannot follow.  It finds the
+///   coefficients b[0] .. b[D] of
+///
+///          y - bias.y = b[0] + b[1] * (x - bias.x) + b[2] * (x - bias.x)^2 + ... + b[D] * (x - bias.x)^D
+///
+///   (x and y swapped for a y independent variable).  Unlike LinearModel, QuadraticModel, and CubicModel, the
+///   coefficients are kept about the bias (the mean of the points) instead of being expanded about the origin,
+///   where the powers of a high degree would lose the precision of the fit.
+///
+///   Notes: The summations, the normal equations, and the solve are all sized by D, so every loop over the
+///          powers has a constant bound and there is no branching on the degree.  The normal equations are the
+///          same centered ones the cubic solves with cofactors,
+///
+///          S * [b1 .. bD]' = [sY1 .. sYD]'    where  sjk = SUM(x^(j+k)) - SUM(x^j) * SUM(x^k) / N
+///                                                    sYk = SUM(x^k * y) - SUM(x^k) * SUM(y) / N
+///
+///          solved by an LDL' (Cholesky) factorization of S.  Each pivot is checked relative to its diagonal 
+///          element, which makes the check independent of the scale of x (the powers up to x^2D span many orders 
+///          of magnitude), so a small pivot means the points do not determine the polynomial, whatever their units.
+///
+/// </summary>
+template <int D>
+class PolynomialDegreeRegression
+{
+protected:
+    constexpr static float DEFAULT_SENSITIVITY = 0.35f;
+
+public:
+    class PolynomialDegreeModel final : public PolynomialModel
+    {
+        static_assert(D >= 1 && D <= MAXIMUM_DEGREE, "The degree must be between 1 and PolynomialModel::MAXIMUM_DEGREE");
+
+    public:
+        double b[D + 1];    // Coefficients of   y - bias.y = b[0] + b[1] * (x - bias.x) + ... + b[D] * (x - bias.x)^D
+
+        // The smallest pivot of a valid model, relative to its diagonal element of the scatter matrix
+        constexpr static double PIVOT_TOLERANCE = 1e-13;
+
+    public:
+
+        PolynomialDegreeModel(enmIndependentVariable independentVariable)
+        {
+            _degree = (DegreeOfPolynomial)D;
+            MinimumPoints = D + 1;
+            for (auto k = 0; k <= D; ++k)
+            {
+                b[k] = 0;
+            }
+            this->independentVariable = independentVariable;
+        }
+
+        PolynomialDegreeModel(const PolynomialDegreeModel& copy)
+            : PolynomialModel(copy)
+        {
+            for (auto k = 0; k <= D; ++k)
+            {
+                b[k] = copy.b[k];
+            }
+            summations = copy.summations;
+        }
+
+        RegressionModel* Clone() override
+        {
+            PolynomialDegreeModel* newModel = new PolynomialDegreeModel(*this);
+            return newModel;
+        }
+
+        PolynomialDegreeModel& operator=(const PolynomialDegreeModel& other)
+        {
+            PolynomialModel::operator=(other);
+
+            for (auto k = 0; k <= D; ++k)
+            {
+                b[k] = other.b[k];
+            }
+            summations = other.summations;
+
+            return *this;
+        }
+
+        float ModeledY(float x) override
+        {
+            if (ValidRegressionModel && independentVariable == enmIndependentVariable::X)
+            {
+                return Modeled(x, (float)bias.x, bias.y);
+            }
+            else
+            {
+                return -99999999.9f;
+            }
+        }
+
+        float ModeledX(float y) override
+        {
+            if (ValidRegressionModel && independentVariable == enmIndependentVariable::Y)
+            {
+                return Modeled(y, (float)bias.y, bias.x);
+            }
+            else
+            {
+                return -99999999.9f;
+            }
+        }
+
+        // The modeled value minus the observed value of the dependent variable, as CalculateSignedRegressionError,
+        // in one loop with the axes swapped once for a y independent variable
+        void CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors) override
+        {
+            if (!ValidRegressionModel)
+            {
+                RegressionModel::CalculateSignedRegressionErrors(points, errors);
+                return;
+            }
+
+            auto xIndependent = independentVariable == enmIndependentVariable::X;
+            auto xs = xIndependent ? points.Xs() : points.Ys();
+            auto ys = xIndependent ? points.Ys() : points.Xs();
+            auto biasX = (float)(xIndependent ? bias.x : bias.y);
+            auto biasY = xIndependent ? bias.y : bias.x;
+            auto stride = points.Stride();
+            auto N = points.Count();
+            for (auto i = 0; i < N; ++i)
+            {
+                errors[i] = Modeled(xs[i * stride], biasX, biasY) - ys[i * stride];
+            }
+        }
+
+    protected:
+        class PolynomialDegreeSummations : public Summations
+        {
+        public:
+            double sumX[2 * D + 1];     // SUM(x^k), k = 0..2D     (sumX[0] and sumX[1] are N and x)
+            double sumXY[D + 1];        // SUM(x^k * y), k = 0..D  (sumXY[0] is y)
+            double y2;
+        };
+
+        PolynomialDegreeSummations summations;
+
+        // The polynomial at x, evaluated about the bias (removed in float, the same way the summations were
+        // calculated) by Horner's rule
+        float Modeled(float x, float biasX, double biasY)
+        {
+            auto t = (double)(x - biasX);
+            auto value = b[D];
+            for (auto k = D - 1; k >= 0; --k)
+            {
+                value = value * t + b[k];
+            }
+            return (float)(value + biasY);
+        }
+
+        // Copy the leading power sums to the fields of Summations, which the shared code reads
+        static void SyncSummations(PolynomialDegreeSummations& sum)
+        {
+            sum.N = (int)sum.sumX[0];
+            sum.x = sum.sumX[1];
+            sum.y = sum.sumXY[0];
+        }
+
+    public:
+        void CalculateSummations(const PointCloud2D& points, Summations& sums) override
+        {
+            auto& sum = static_cast<PolynomialDegreeSummations&>(sums);
+            if (points.Count() < MinimumPoints)
+            {
+                sum.N = 0;
+                return;
+            }
+
+            // The power sums of the points with the model's bias removed, the same way UpdateSummations does.  The
+            // x and y arrays (and biases) swap to handle a y independent variable.
+            auto xIndependent = independentVariable == enmIndependentVariable::X;
+            auto xs = xIndependent ? points.Xs() : points.Ys();
+            auto ys = xIndependent ? points.Ys() : points.Xs();
+            auto biasX = (float)(xIndependent ? bias.x : bias.y);
+            auto biasY = (float)(xIndependent ? bias.y : bias.x);
+            SummationKernels::PolynomialSums(xs, ys, points.Count(), points.Stride(), biasX, biasY, D, sum.sumX, sum.sumXY, sum.y2);
+            SyncSummations(sum);
+        }
+
+        Summations& ModelSummations() override
+        {
+            return summations;
+        }
+
+        void UpdateSummations(Summations& sums, PointF point, double weight) override
+        {
+            auto& sum = static_cast<PolynomialDegreeSummations&>(sums);
+
+            // Remove the bias the same way the summations were calculated
+            auto x = (double)(point.X - (float)bias.x);
+            auto y = (double)(point.Y - (float)bias.y);
+
+            if (independentVariable == enmIndependentVariable::Y)
+            {
+                // Swap the x and y coordinates to handle a y independent variable
+                swap(x, y);
+            }
+
+            auto power = 1.0;
+            for (auto k = 0; k <= 2 * D; ++k)
+            {
+                sum.sumX[k] += weight * power;
+                if (k <= D)
+                {
+                    sum.sumXY[k] += weight * power * y;
+                }
+                power *= x;
+            }
+            sum.y2 += weight * y * y;
+            SyncSummations(sum);
+        }
+
+        void ShiftSummations(Summations& sums, double dx, double dy) override
+        {
+            auto& sum = static_cast<PolynomialDegreeSummations&>(sums);
+            if (independentVariable == enmIndependentVariable::Y)
+            {
+                // The summations are of the swapped coordinates
+                swap(dx, dy);
+            }
+
+            ShiftPowerSums(sum.sumX, 2 * D, sum.sumXY, D, sum.y2, dx, dy);
+            SyncSummations(sum);
+        }
+
+        double CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight) override
+        {
+            return UpdatedResidualSumOfSquares(*this, static_cast<PolynomialDegreeSummations&>(sums), point, weight);
+        }
+
+        void CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+            double* residualSumsOfSquares) override
+        {
+            UpdatedResidualSumsOfSquares(*this, static_cast<PolynomialDegreeSummations&>(sums), points, mask, weight, residualSumsOfSquares);
+        }
+
+        void CalculateModel(Summations& sums) override
+        {
+            if (sums.N <= 0)
+            {
+                ValidRegressionModel = false;
+                return;
+            }
+
+            auto& sum = static_cast<PolynomialDegreeSummations&>(sums);
+
+            // The centered scatter matrix S of the powers x^1 .. x^D and the right-hand side sY (see notes above)
+            auto inv_N = 1.0 / sum.sumX[0];
+            double S[D][D];
+            double sY[D];
+            for (auto j = 0; j < D; ++j)
+            {
+                for (auto k = 0; k <= j; ++k)
+                {
+                    S[j][k] = S[k][j] = sum.sumX[j + k + 2] - inv_N * sum.sumX[j + 1] * sum.sumX[k + 1];
+                }
+                sY[j] = sum.sumXY[j + 1] - inv_N * sum.sumX[j + 1] * sum.sumXY[0];
+            }
+            auto sYY = sum.y2 - inv_N * sum.sumXY[0] * sum.sumXY[0];
+
+            // S = L * diag(P) * L' with L unit lower triangular (the strict lower triangle is stored in L), keeping
+            // the reciprocals of the pivots P as well
+            double L[D][D];
+            double P[D];
+            double invP[D];
+            for (auto j = 0; j < D; ++j)
+            {
+                auto pivot = S[j][j];
+                for (auto m = 0; m < j; ++m)
+                {
+                    pivot -= L[j][m] * L[j][m] * P[m];
+                }
+
+                // Don't divide by (nearly) zero: the pivot relative to its diagonal element is the pivot of S 
+                // scaled to a unit diagonal, whatever the scale of x
+                if (!(pivot > PIVOT_TOLERANCE * S[j][j]))
+                {
+                    ValidRegressionModel = false;
+                    return;
+                }
+                P[j] = pivot;
+                invP[j] = 1.0 / pivot;
+
+                for (auto i = j + 1; i < D; ++i)
+                {
+                    auto a = S[i][j];
+                    for (auto m = 0; m < j; ++m)
+                    {
+                        a -= L[i][m] * L[j][m] * P[m];
+                    }
+                    L[i][j] = a * invP[j];
+                }
+            }
+
+            // Solve for [b1 .. bD] by forward and back substitution
+            double c[D];
+            for (auto i = 0; i < D; ++i)
+            {
+                c[i] = sY[i];
+                for (auto m = 0; m < i; ++m)
+                {
+                    c[i] -= L[i][m] * c[m];
+                }
+            }
+            for (auto i = D - 1; i >= 0; --i)
+            {
+                c[i] *= invP[i];
+                for (auto m = i + 1; m < D; ++m)
+                {
+                    c[i] -= L[m][i] * c[m];
+                }
+            }
+
+            auto rss = sYY;
+            for (auto k = 0; k < D; ++k)
+            {
+                b[k + 1] = c[k];
+                rss -= b[k + 1] * sY[k];
+            }
+
+            // The residual sum of squares, sYY - b1*sY1 - ... - bD*sYD
+            residualSumOfSquares = max(0.0, rss);
+
+            // The constant term from the means, b0 = MEAN(y) - b1*MEAN(x) - ... - bD*MEAN(x^D)
+            auto yMean = inv_N * sum.sumXY[0];
+            b[0] = yMean;
+            for (auto k = 0; k < D; ++k)
+            {
+                b[0] -= b[k + 1] * inv_N * sum.sumX[k + 1];
+            }
+
+            // Keep the normal equations for the regression diagnostics, with INV(S) = M' * diag(1 / P) * M from
+            // the inverse of the unit triangle, M = INV(L)
+            double M[D][D];
+            for (auto j = 0; j < D; ++j)
+            {
+                for (auto i = j + 1; i < D; ++i)
+                {
+                    auto m = -L[i][j];
+                    for (auto k = j + 1; k < i; ++k)
+                    {
+                        m -= L[i][k] * M[k][j];
+                    }
+                    M[i][j] = m;
+                }
+            }
+
+            normalEquations.N = sum.N;
+            normalEquations.yMean = yMean;
+            for (auto k = 0; k < D; ++k)
+            {
+                normalEquations.powerMeans[k] = inv_N * sum.sumX[k + 1];
+                normalEquations.coefficients[k] = b[k + 1];
+                for (auto j = 0; j <= k; ++j)
+                {
+                    // SUM over i >= k of M[i][j] * M[i][k] / P[i], with the unit diagonal M[k][k] = 1
+                    auto inverse = (j == k ? 1.0 : M[k][j]) * invP[k];
+                    for (auto i = k + 1; i < D; ++i)
+                    {
+                        inverse += M[i][j] * M[i][k] * invP[i];
+                    }
+                    normalEquations.inverseS[j][k] = normalEquations.inverseS[k][j] = inverse;
+                }
+            }
+
+            ValidRegressionModel = true;
+        }
+
+        void CalculateFeatures() override
+        {
+
+        }
+
+    };
+
+    class PolynomialDegreeConsensusModel : public RegressionConsensusModel
+    {
+    public:
+        PolynomialDegreeConsensusModel(PolynomialModel::enmIndependentVariable independentVariable) : RegressionConsensusModel()
+        {
+            model = new PolynomialDegreeModel(independentVariable);
+            original = new PolynomialDegreeModel(independentVariable);
+
+            inliers = vector<PointF>();
+            outliers = vector<PointF>();
+        }
+
+        // Each consensus model owns (and deletes) its models, so a copy clones them
+        PolynomialDegreeConsensusModel(const PolynomialDegreeConsensusModel& copy) : RegressionConsensusModel()
+        {
+            RegressionConsensusModel::operator=(copy);
+            model = copy.model->Clone();
+            original = copy.original->Clone();
+        }
+
+        PolynomialDegreeConsensusModel& operator=(const PolynomialDegreeConsensusModel& other)
+        {
+            if (this != &other)
+            {
+                delete model;
+                delete original;
+
+                RegressionConsensusModel::operator=(other);
+                model = other.model->Clone();
+                original = other.original->Clone();
+            }
+            return *this;
+        }
+
+        ~PolynomialDegreeConsensusModel()
+        {
+            delete model;
+            delete original;
+        }
+
+    protected:
+        float CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide) override
+        {
+            if (point.IsEmpty)
+            {
+                pointOnPositiveSide = false;
+                return 99999999.9f;
+            }
+
+            auto error = static_cast<PolynomialDegreeModel&>(model).CalculateSignedRegressionError(point);
+            pointOnPositiveSide = error >= 0.0f;
+            return abs(error);
+        }
+
+        // The same error as CalculateError from the residuals cached when the model was scored
+        void ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex) override
+        {
+            auto& pmodel = static_cast<PolynomialDegreeModel&>(model);
+            if (!ResidualsAvailable(pmodel))
+            {
+                RegressionConsensusModel::ScanCandidates(model, positiveIndex, negativeIndex, influenceIndex);
+                return;
+            }
+
+            auto useCooksDistance = influenceError == InfluenceError::CooksDistance && CalculateCooksDistances(pmodel);
+
+            RegressionConsensusModel::ScanCandidates(
+                [&](int i, PointF point, bool& pointOnPositiveSide)
+                {
+                    auto error = pmodel.residuals[i];
+                    pointOnPositiveSide = !point.IsEmpty & (error >= 0.0f);
+                    return point.IsEmpty ? 99999999.9f : abs(error);
+                },
+                [&](int i, PointF point) { return useCooksDistance ? influences[i] : CalculateDistanceInfluence(influenceError, point, pmodel); },
+                positiveIndex, negativeIndex, influenceIndex);
+        }
+    };
+
+    static PolynomialDegreeConsensusModel& CalculatePolynomialDegreeRegressionConsensus(const vector<PointF>& points, PolynomialModel::enmIndependentVariable independentVariable = PolynomialModel::enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY)
+    {
+        auto consensus = new PolynomialDegreeConsensusModel(independentVariable);
+        consensus->Calculate(points, sensitivityInPixels);
+
+        return *consensus;
+    }
+
+    // Warm start from a prior consensus (e.g. of the previous frame), keeping its independent variable.  If the prior labeled 
+    // as many points, its inlier labels are the starting inliers (the points are taken to be in the same order).
+    static PolynomialDegreeConsensusModel& CalculatePolynomialDegreeRegressionConsensus(const vector<PointF>& points, PolynomialDegreeConsensusModel& prior, float sensitivityInPixels = DEFAULT_SENSITIVITY)
+    {
+        auto consensus = new PolynomialDegreeConsensusModel(static_cast<PolynomialDegreeModel&>(*prior.model).independentVariable);
+        consensus->CalculateWarmStart(points, sensitivityInPixels, *prior.model, prior.inlierMask);
+
+        return *consensus;
+    }
+
+public: // Unit tests
+    // Checks that return 0 on success and non-zero on failure
+    static int UnitTest1(vector<PointF>& points)
+    {
+        ///////////////////////////////////////////////
+        // Unit test #1:  Polynomial of degree D     //
+        ///////////////////////////////////////////////
+
+        // The polynomial y - 400 = (x - 500)^D - (x - 500) sampled at x = 497, 497.5, .. 503.  We should be
+        // able to fit to these points, with no outliers, and return b[D] = 1 and b[1] = -1 (a flat line for D = 1).
+
+        points = vector<PointF>();
+        for (auto i = 0; i <= 12; ++i)
+        {
+            auto t = -3.0 + 0.5 * i;
+            points.push_back(PointF((float)(500.0 + t), (float)(400.0 + pow(t, D) - t)));
+        }
+
+        PolynomialDegreeConsensusModel consensus(PolynomialModel::enmIndependentVariable::X);
+        consensus.Calculate(points, DEFAULT_SENSITIVITY);
+        if (!consensus.outliers.empty())
+        {
+            return 1;
+        }
+
+        return CheckCoefficients(static_cast<PolynomialDegreeModel&>(*consensus.model)) ? 0 : 2;
+    }
+
+    static int UnitTest2(vector<PointF>& points)
+    {
+        //////////////////////////////////////////////////////////////////
+        // Unit test #2:  Polynomial of degree D, y-independent, outlier //
+        //////////////////////////////////////////////////////////////////
+
+        // The same polynomial with x and y exchanged, x - 400 = (y - 500)^D - (y - 500), and one outlier at
+        // y = 501 that the consensus should remove.
+
+        points = vector<PointF>();
+        for (auto i = 0; i <= 12; ++i)
+        {
+            auto t = -3.0 + 0.5 * i;
+            points.push_back(PointF((float)(400.0 + pow(t, D) - t), (float)(500.0 + t)));
+        }
+        points.push_back(PointF(410.0f, 501.0f));
+
+        PolynomialDegreeConsensusModel consensus(PolynomialModel::enmIndependentVariable::Y);
+        consensus.Calculate(points, DEFAULT_SENSITIVITY);
+        if (consensus.outliers.size() != 1 || consensus.outliers[0].X != 410.0f || consensus.outliers[0].Y != 501.0f)
+        {
+            return 1;
+        }
+
+        return CheckCoefficients(static_cast<PolynomialDegreeModel&>(*consensus.model)) ? 0 : 2;
+    }
+
+private:
+    // True if the model is the fit of UnitTest1 and UnitTest2:  b[1] = -1 and b[D] = 1, or a flat line for D = 1
+    static bool CheckCoefficients(PolynomialDegreeModel& model)
+    {
+        auto expectedB1 = D == 1 ? 0.0 : -1.0;
+        auto expectedBD = D == 1 ? 0.0 : 1.0;
+        return model.ValidRegressionModel && abs(model.b[1] - expectedB1) < 0.001 && abs(model.b[D] - expectedBD) < 0.001;
+    }
+};
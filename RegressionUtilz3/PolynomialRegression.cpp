@@ -1,3 +1,4 @@
+#include <cmath>
 #include <iostream>
 
 #include "PolynomialRegression.h"
@@ -17,6 +18,101 @@ float PolynomialModel::CalculateRegressionError(PointF point)
     }
 }
 
+float PolynomialModel::CalculateSignedRegressionError(PointF point)
+{
+    if (independentVariable == enmIndependentVariable::X)
+    {
+        return ModeledY(point.X) - point.Y;
+    }
+    else
+    {
+        return ModeledX(point.Y) - point.X;
+    }
+}
+
+// Leverage, studentized residual, and Cook's distance of each point in a single pass
+// Returns 0 on success, returns non-zero on failure
+int PolynomialModel::CalculateInfluence(const PointCloud2D& points, vector<PointInfluence>& influence)
+{
+    influence = vector<PointInfluence>();
+    if (!InfluenceAvailable())
+    {
+        return 1;
+    }
+
+    influence.resize(points.Count());
+    DispatchPointInfluences(points, [&](int i, PointInfluence pointInfluence) { influence[i] = pointInfluence; });
+
+    return 0;
+}
+
+void PolynomialModel::ShiftPowerSums(double* sumX, int degreeX, double* sumXY, int degreeXY, double& sumY2, double dx, double dy)
+{
+    // SUM((y - dy)^2) = SUM(y^2) - 2 dy SUM(y) + N dy^2
+    sumY2 += dy * (dy * sumX[0] - 2.0 * sumXY[0]);
+
+    // SUM((x - dx)^k) = SUM over p of C(k, p) (-dx)^(k - p) SUM(x^p)
+    // SUM((x - dx)^k (y - dy)) is the same expansion of SUM(x^p * y) - dy SUM(x^p)
+    double shiftedX[2 * MAXIMUM_DEGREE + 1] = {};
+    double shiftedXY[MAXIMUM_DEGREE + 1] = {};
+    double C[2 * MAXIMUM_DEGREE + 1] = { 1.0 };     // Row k of Pascal's triangle
+    double powX[2 * MAXIMUM_DEGREE + 1] = { 1.0 };  // (-dx)^k
+    for (auto k = 0; k <= degreeX; ++k)
+    {
+        if (k > 0)
+        {
+            powX[k] = powX[k - 1] * -dx;
+            for (auto p = k; p > 0; --p)
+            {
+                C[p] += C[p - 1];
+            }
+        }
+
+        for (auto p = 0; p <= k; ++p)
+        {
+            shiftedX[k] += C[p] * powX[k - p] * sumX[p];
+            if (k <= degreeXY)
+            {
+                shiftedXY[k] += C[p] * powX[k - p] * (sumXY[p] - dy * sumX[p]);
+            }
+        }
+    }
+
+    for (auto k = 0; k <= degreeX; ++k)
+    {
+        sumX[k] = shiftedX[k];
+    }
+    for (auto k = 0; k <= degreeXY; ++k)
+    {
+        sumXY[k] = shiftedXY[k];
+    }
+}
+
+bool PolynomialModel::InfluenceAvailable()
+{
+    return ValidRegressionModel && normalEquations.N > (int)Degree() + 1;
+}
+
+RegressionModel::PointInfluence PolynomialModel::CalculatePointInfluence(PointF point)
+{
+    PointInfluence influence;
+    DispatchPointInfluences(PointCloud2D::View(&point, 1), [&](int, PointInfluence pointInfluence) { influence = pointInfluence; });
+    return influence;
+}
+
+// The Cook's distance of every point, choosing the axes and the degree once rather than per point
+// Returns 0 on success, returns non-zero on failure
+int PolynomialModel::CalculateCooksDistances(const PointCloud2D& points, float* distances)
+{
+    if (!InfluenceAvailable())
+    {
+        return 1;
+    }
+
+    DispatchPointInfluences(points, [&](int i, PointInfluence pointInfluence) { distances[i] = pointInfluence.cooksDistance; });
+    return 0;
+}
+
 // Return the degree of the regression model
 unsigned int PolynomialModel::Degree()
 {
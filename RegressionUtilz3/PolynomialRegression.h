@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 
 #include "RegressionModel.h"
 
@@ -6,7 +8,9 @@
 /// PolynomialModel
 /// Author: Merrill McKee
 /// Description:  This is the abstract parent class for linear, quadratic, cubic, and 
-///   any other polynomial regression algorithms. (todo: combine into single polynomial regression)
+///   any other polynomial regression algorithms. (todo: combine into single polynomial regression; 
+///   PolynomialDegreeRegression fits any degree up to MAXIMUM_DEGREE, but LinearRegression, QuadraticRegression, 
+///   and CubicRegression are still kept alongside it)
 ///   
 /// </summary>
 class PolynomialModel : public RegressionModel
@@ -23,6 +27,122 @@ protected:
     {
         _degree = copy._degree;
         independentVariable = copy.independentVariable;
+        normalEquations = copy.normalEquations;
+    }
+
+    const static int MAXIMUM_DEGREE = 8;
+
+    // The centered normal equations of the last solve (in the bias frame), kept for the regression diagnostics
+    //   S * [b2 .. bD+1]' = [sY1 .. sYD]'   where S is the centered scatter matrix of the powers of x
+    struct NormalEquations
+    {
+        int N = 0;
+        double yMean = 0.0;
+        double powerMeans[MAXIMUM_DEGREE] = {};                     // MEAN(x^k), k = 1..D
+        double coefficients[MAXIMUM_DEGREE] = {};                   // [b2 .. bD+1] before the bias is added back
+        double inverseS[MAXIMUM_DEGREE][MAXIMUM_DEGREE] = {};       // INV(S)
+    };
+    NormalEquations normalEquations;
+
+    // The binomial shift, in place, of the power sums that make up a polynomial's summations
+    //   sumX[k] = SUM(x^k), k = 0..degreeX     sumXY[k] = SUM(x^k * y), k = 0..degreeXY     sumY2 = SUM(y^2)
+    // to the power sums of (x - dx) and (y - dy).  degreeX is at most 2 * MAXIMUM_DEGREE.
+    static void ShiftPowerSums(double* sumX, int degreeX, double* sumXY, int degreeXY, double& sumY2, double dx, double dy);
+
+    // The summations of a y independent variable are of the swapped coordinates
+    bool SummationsSwapped() override
+    {
+        return independentVariable == enmIndependentVariable::Y;
+    }
+
+    // The diagnostics of each point (xs[i], ys[i]) in the frame of the summations (the axes already swapped for a 
+    // y independent variable), passed to output(i, influence).  The degree is a template parameter, so the loop 
+    // is straight-line code with no branches on the degree or the independent variable.
+    template <int D, typename Output>
+    void CalculatePointInfluences(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, Output output)
+    {
+        auto p = D + 1;                     // Number of coefficients
+        auto N = normalEquations.N;
+
+        // Estimated variance of the residuals
+        auto variance = residualSumOfSquares / (double)(N - p);
+
+        for (auto i = 0; i < count; ++i)
+        {
+            // Remove the bias the same way the summations were calculated
+            auto x = (double)(xs[i * stride] - biasX);
+            auto y = (double)(ys[i * stride] - biasY);
+
+            // Centered powers z of x, the residual, and the quadratic form z' INV(S) z
+            double z[D];
+            auto power = 1.0;
+            auto residual = y - normalEquations.yMean;
+            for (auto k = 0; k < D; ++k)
+            {
+                power *= x;
+                z[k] = power - normalEquations.powerMeans[k];
+                residual -= normalEquations.coefficients[k] * z[k];
+            }
+
+            auto quadraticForm = 0.0;
+            for (auto j = 0; j < D; ++j)
+            {
+                for (auto k = 0; k < D; ++k)
+                {
+                    quadraticForm += z[j] * normalEquations.inverseS[j][k] * z[k];
+                }
+            }
+
+            auto leverage = 1.0 / (double)N + quadraticForm;
+            auto oneMinusLeverage = max(1.0 - leverage, EPSILON);
+            auto studentizedResidual = variance > 0.0 ? residual / sqrt(variance * oneMinusLeverage) : 0.0;
+
+            PointInfluence influence;
+            influence.leverage = (float)leverage;
+            influence.studentizedResidual = (float)studentizedResidual;
+            influence.cooksDistance = (float)(studentizedResidual * studentizedResidual * leverage / (p * oneMinusLeverage));
+            output(i, influence);
+        }
+    }
+
+    // CalculatePointInfluences of the points, choosing the axes and the degree once for all of them
+    template <typename Output>
+    void DispatchPointInfluences(const PointCloud2D& points, Output output)
+    {
+        auto xIndependent = independentVariable == enmIndependentVariable::X;
+        auto xs = xIndependent ? points.Xs() : points.Ys();
+        auto ys = xIndependent ? points.Ys() : points.Xs();
+        auto biasX = (float)(xIndependent ? bias.x : bias.y);
+        auto biasY = (float)(xIndependent ? bias.y : bias.x);
+        auto count = points.Count();
+        auto stride = points.Stride();
+        switch (_degree)
+        {
+        case DegreeOfPolynomial::Linear:
+            CalculatePointInfluences<1>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Quadratic:
+            CalculatePointInfluences<2>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Cubic:
+            CalculatePointInfluences<3>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Quartic:
+            CalculatePointInfluences<4>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Quintic:
+            CalculatePointInfluences<5>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Sextic:
+            CalculatePointInfluences<6>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Septic:
+            CalculatePointInfluences<7>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        case DegreeOfPolynomial::Octic:
+            CalculatePointInfluences<8>(xs, ys, count, stride, biasX, biasY, output);
+            break;
+        }
     }
 
 public:
@@ -31,7 +151,12 @@ public:
     {
         Linear = 1,
         Quadratic = 2,
-        Cubic = 3
+        Cubic = 3,
+        Quartic = 4,
+        Quintic = 5,
+        Sextic = 6,
+        Septic = 7,
+        Octic = 8
     };
     DegreeOfPolynomial _degree;
 
@@ -48,6 +173,7 @@ public:
 
         _degree = other._degree;
         independentVariable = other.independentVariable;
+        normalEquations = other.normalEquations;
 
         return *this;
     }
@@ -61,6 +187,24 @@ public:
     // Calculate the single-point regression error
     float CalculateRegressionError(PointF point) override;
 
+    // The modeled value minus the observed value of the dependent variable
+    float CalculateSignedRegressionError(PointF point) override;
+
+    // Leverage, studentized residual, and Cook's distance of each point from the kept normal equations:
+    //   h = 1/N + z' INV(S) z    where z = [x - MEAN(x), x^2 - MEAN(x^2), ...]
+    //   r = e / sqrt(s^2 (1 - h))    where s^2 = RSS / (N - p) and p = D + 1
+    //   D = r^2 h / (p (1 - h))
+    int CalculateInfluence(const PointCloud2D& points, vector<PointInfluence>& influence) override;
+
+    // True if the last solve can provide the regression diagnostics (a valid model with N > D + 1)
+    bool InfluenceAvailable();
+
+    // The diagnostics of a single point (check InfluenceAvailable first)
+    PointInfluence CalculatePointInfluence(PointF point);
+
+    // The Cook's distance of every point, in one pass
+    int CalculateCooksDistances(const PointCloud2D& points, float* distances) override;
+
     // Return the degree of the regression model
     unsigned int Degree();
 };
\ No newline at end of file
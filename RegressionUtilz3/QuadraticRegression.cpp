@@ -1,4 +1,5 @@
 #include "QuadraticRegression.h"
+#include "SummationKernels.h"
 
 const float QuadraticRegression::DEFAULT_SENSITIVITY = 0.35f;
 
@@ -26,7 +27,29 @@ float QuadraticRegression::QuadraticModel::ModeledX(float y)
     }
 }
 
-QuadraticRegression::QuadraticConsensusModel& QuadraticRegression::CalculateQuadraticRegressionConsensus(vector<PointF> points, enmIndependentVariable independentVariable, float sensitivity)
+// The modeled value minus the observed value of the dependent variable, as CalculateSignedRegressionError, in one 
+// loop with the axes swapped once for a y independent variable
+void QuadraticRegression::QuadraticModel::CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors)
+{
+    if (!ValidRegressionModel)
+    {
+        RegressionModel::CalculateSignedRegressionErrors(points, errors);
+        return;
+    }
+
+    auto xIndependent = independentVariable == enmIndependentVariable::X;
+    auto xs = xIndependent ? points.Xs() : points.Ys();
+    auto ys = xIndependent ? points.Ys() : points.Xs();
+    auto stride = points.Stride();
+    auto N = points.Count();
+    for (auto i = 0; i < N; ++i)
+    {
+        auto x = xs[i * stride];
+        errors[i] = (float)(b1 + b2 * x + b3 * x * x) - ys[i * stride];
+    }
+}
+
+QuadraticRegression::QuadraticConsensusModel& QuadraticRegression::CalculateQuadraticRegressionConsensus(const vector<PointF>& points, enmIndependentVariable independentVariable, float sensitivity)
 {
     auto consensus = new QuadraticConsensusModel(independentVariable);
     consensus->Calculate(points, sensitivity);
@@ -34,6 +57,14 @@ QuadraticRegression::QuadraticConsensusModel& QuadraticRegression::CalculateQuad
     return *consensus;
 }
 
+QuadraticRegression::QuadraticConsensusModel& QuadraticRegression::CalculateQuadraticRegressionConsensus(const vector<PointF>& points, QuadraticConsensusModel& prior, float sensitivity)
+{
+    auto consensus = new QuadraticConsensusModel(static_cast<QuadraticModel&>(*prior.model).independentVariable);
+    consensus->CalculateWarmStart(points, sensitivity, *prior.model, prior.inlierMask);
+
+    return *consensus;
+}
+
 float QuadraticRegression::QuadraticConsensusModel::CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide)
 {
     if (point.IsEmpty)
@@ -43,7 +74,7 @@ float QuadraticRegression::QuadraticConsensusModel::CalculateError(RegressionMod
     }
 
     auto error = 0.0f;
-    auto qmodel = static_cast<QuadraticModel&>(model);
+    auto& qmodel = static_cast<QuadraticModel&>(model);
     if (qmodel.independentVariable == enmIndependentVariable::X)
     {
         error = qmodel.ModeledY(point.X) - point.Y;
@@ -57,56 +88,118 @@ float QuadraticRegression::QuadraticConsensusModel::CalculateError(RegressionMod
     return abs(error);
 }
 
-RegressionModel::Summations* QuadraticRegression::QuadraticModel::CalculateSummations(vector<PointF> points)
+// The same error as CalculateError from the residuals cached when the model was scored
+void QuadraticRegression::QuadraticConsensusModel::ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex)
 {
-    QuadraticSummations* sum = new QuadraticSummations();
-    if (points.size() < MinimumPoints)
+    auto& qmodel = static_cast<QuadraticModel&>(model);
+    if (!ResidualsAvailable(qmodel))
     {
-        sum->N = 0;
-        return sum;
+        RegressionConsensusModel::ScanCandidates(model, positiveIndex, negativeIndex, influenceIndex);
+        return;
     }
 
-    // Initialize all the summations to zero
-    sum->x = 0.0;
-    sum->y = 0.0;
-    sum->x2 = 0.0;
-    sum->xy = 0.0;
-    sum->x3 = 0.0;
-    sum->x2y = 0.0;  // (i.e.  SUM(x^2*y))
-    sum->x4 = 0.0;
+    auto useCooksDistance = influenceError == InfluenceError::CooksDistance && CalculateCooksDistances(qmodel);
 
-    // Shorthand that better matches the math formulas
-    auto N = sum->N = (int)points.size();
+    RegressionConsensusModel::ScanCandidates(
+        [&](int i, PointF point, bool& pointOnPositiveSide)
+        {
+            auto error = qmodel.residuals[i];
+            pointOnPositiveSide = !point.IsEmpty & (error >= 0.0f);
+            return point.IsEmpty ? 99999999.9f : abs(error);
+        },
+        [&](int i, PointF point) { return useCooksDistance ? influences[i] : CalculateDistanceInfluence(influenceError, point, qmodel); },
+        positiveIndex, negativeIndex, influenceIndex);
+}
 
-    // Calculate the summations
-    for (auto i = 0; i < N; ++i)
+void QuadraticRegression::QuadraticModel::CalculateSummations(const PointCloud2D& points, Summations& sums)
+{
+    auto& sum = static_cast<QuadraticSummations&>(sums);
+    if (points.Count() < MinimumPoints)
+    {
+        sum.N = 0;
+        return;
+    }
+
+    // The power sums of the points with the model's bias removed, the same way UpdateSummations does.  The x and 
+    // y arrays (and biases) swap to handle a y independent variable.
+    auto xIndependent = independentVariable == enmIndependentVariable::X;
+    auto xs = xIndependent ? points.Xs() : points.Ys();
+    auto ys = xIndependent ? points.Ys() : points.Xs();
+    auto biasX = (float)(xIndependent ? bias.x : bias.y);
+    auto biasY = (float)(xIndependent ? bias.y : bias.x);
+    double sumX[5];
+    double sumXY[3];
+    SummationKernels::PolynomialSums(xs, ys, points.Count(), points.Stride(), biasX, biasY, 2, sumX, sumXY, sum.y2);
+
+    sum.N = points.Count();
+    sum.x = sumX[1];
+    sum.x2 = sumX[2];
+    sum.x3 = sumX[3];
+    sum.x4 = sumX[4];
+    sum.y = sumXY[0];
+    sum.xy = sumXY[1];
+    sum.x2y = sumXY[2];
+}
+
+void QuadraticRegression::QuadraticModel::ShiftSummations(Summations& sums, double dx, double dy)
+{
+    QuadraticSummations& sum = static_cast<QuadraticSummations&>(sums);
+    if (independentVariable == enmIndependentVariable::Y)
     {
-        // Shorthand
-        auto x = (double)points[i].X;
-        auto y = (double)points[i].Y;
+        // The summations are of the swapped coordinates
+        swap(dx, dy);
+    }
 
-        // Meh
-        if (independentVariable == enmIndependentVariable::Y)
-        {
-            // Swap the x and y coordinates to handle a y independent variable
-            x = points[i].Y;
-            y = points[i].X;
-        }
+    double sumX[] = { (double)sum.N, sum.x, sum.x2, sum.x3, sum.x4 };
+    double sumXY[] = { sum.y, sum.xy, sum.x2y };
+    ShiftPowerSums(sumX, 4, sumXY, 2, sum.y2, dx, dy);
+    sum.x = sumX[1];
+    sum.x2 = sumX[2];
+    sum.x3 = sumX[3];
+    sum.x4 = sumX[4];
+    sum.y = sumXY[0];
+    sum.xy = sumXY[1];
+    sum.x2y = sumXY[2];
+}
+
+void QuadraticRegression::QuadraticModel::UpdateSummations(Summations& sums, PointF point, double weight)
+{
+    QuadraticSummations& sum = static_cast<QuadraticSummations&>(sums);
+
+    // Remove the bias the same way the summations were calculated
+    auto x = (double)(point.X - (float)bias.x);
+    auto y = (double)(point.Y - (float)bias.y);
 
-        auto xx = x * x;
-        auto xy = x * y;
-
-        // Sums
-        sum->x += x;
-        sum->y += y;
-        sum->x2 += xx;
-        sum->xy += xy;
-        sum->x3 += x * xx;
-        sum->x2y += xx * y;
-        sum->x4 += xx * xx;
+    if (independentVariable == enmIndependentVariable::Y)
+    {
+        // Swap the x and y coordinates to handle a y independent variable
+        swap(x, y);
     }
 
-    return sum;
+    auto xx = x * x;
+    auto xy = x * y;
+
+    // Sums
+    sum.N += (int)weight;
+    sum.x += weight * x;
+    sum.y += weight * y;
+    sum.x2 += weight * xx;
+    sum.xy += weight * xy;
+    sum.x3 += weight * x * xx;
+    sum.x2y += weight * xx * y;
+    sum.x4 += weight * xx * xx;
+    sum.y2 += weight * y * y;
+}
+
+double QuadraticRegression::QuadraticModel::CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight)
+{
+    return UpdatedResidualSumOfSquares(*this, static_cast<QuadraticSummations&>(sums), point, weight);
+}
+
+void QuadraticRegression::QuadraticModel::CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+    double* residualSumsOfSquares)
+{
+    UpdatedResidualSumsOfSquares(*this, static_cast<QuadraticSummations&>(sums), points, mask, weight, residualSumsOfSquares);
 }
 
 void QuadraticRegression::QuadraticModel::CalculateFeatures()
@@ -149,6 +242,7 @@ void QuadraticRegression::QuadraticModel::CalculateModel(Summations& sums)
     auto s22 = sum.x4 - (1.0 / (double)sum.N) * sum.x2 * sum.x2;
     auto sY1 = sum.xy - (1.0 / (double)sum.N) * sum.x * sum.y;
     auto sY2 = sum.x2y - (1.0 / (double)sum.N) * sum.x2 * sum.y;
+    auto sYY = sum.y2 - (1.0 / (double)sum.N) * sum.y * sum.y;
 
     // Don't divide by zero
     auto determinantS = s22 * s11 - s12 * s12;
@@ -163,6 +257,20 @@ void QuadraticRegression::QuadraticModel::CalculateModel(Summations& sums)
     b3 = (sY2 * s11 - sY1 * s12) / determinantS;
     b1 = YMean - b2 * XMean - b3 * XXMean;
 
+    // The residual sum of squares, sYY - b2*sY1 - b3*sY2
+    residualSumOfSquares = max(0.0, sYY - b2 * sY1 - b3 * sY2);
+
+    // Keep the normal equations for the regression diagnostics
+    normalEquations.N = sum.N;
+    normalEquations.yMean = YMean;
+    normalEquations.powerMeans[0] = XMean;
+    normalEquations.powerMeans[1] = sum.x2 / (double)sum.N;
+    normalEquations.coefficients[0] = b2;
+    normalEquations.coefficients[1] = b3;
+    normalEquations.inverseS[0][0] = s22 / determinantS;
+    normalEquations.inverseS[0][1] = normalEquations.inverseS[1][0] = -s12 / determinantS;
+    normalEquations.inverseS[1][1] = s11 / determinantS;
+
     // Adjust for the bias
     if (independentVariable == enmIndependentVariable::X)
     {
@@ -412,3 +520,103 @@ QuadraticRegression::QuadraticConsensusModel& QuadraticRegression::UnitTest9(vec
 
     return CalculateQuadraticRegressionConsensus(pointsPAc, enmIndependentVariable::Y);
 }
+
+int QuadraticRegression::UnitTest10(vector<PointF>& points)
+{
+    /////////////////////////////////////////////////////////////////////
+    // Unit test #10:  Cook's distance matches leave-one-out refits    //
+    /////////////////////////////////////////////////////////////////////
+
+    // A parabola y = 0.5x^2 - 2x + 3 with some noise and one outlier.  The Cook's distance of each point, 
+    // calculated in one pass from the solved normal equations, should match its definition:
+    //   D(i) = SUM(j) (yhat(j) - yhat(j) without point i)^2 / (p * s^2)
+    // where the fit without point i is a full refit of the remaining points.
+
+    points = vector<PointF>();
+    for (auto i = 0; i < 21; ++i)
+    {
+        auto x = -5.0f + 0.5f * i;
+        auto noise = (i % 3 - 1) * 0.15f;
+        points.push_back(PointF(x, 0.5f * x * x - 2.0f * x + 3.0f + noise));
+    }
+    points.push_back(PointF(1.25f, 6.0f));  // <--- Outlier
+
+    QuadraticModel quadratic(enmIndependentVariable::X);
+    RegressionModel& fit = quadratic;
+    fit.CalculateModel(points);
+
+    auto N = (int)points.size();
+    auto cooksDistances = vector<float>(N);
+    if (fit.CalculateCooksDistances(PointCloud2D::View(points), cooksDistances.data()) != 0)
+    {
+        return 1;
+    }
+
+    auto p = 3;
+    auto variance = fit.residualSumOfSquares / (double)(N - p);
+    for (auto i = 0; i < N; ++i)
+    {
+        auto pointsWithoutI = points;
+        pointsWithoutI.erase(pointsWithoutI.begin() + i);
+
+        QuadraticModel quadraticWithoutI(enmIndependentVariable::X);
+        RegressionModel& fitWithoutI = quadraticWithoutI;
+        fitWithoutI.CalculateModel(pointsWithoutI);
+
+        auto change = 0.0;
+        for (auto j = 0; j < N; ++j)
+        {
+            auto difference = (double)quadratic.ModeledY(points[j].X) - (double)quadraticWithoutI.ModeledY(points[j].X);
+            change += difference * difference;
+        }
+
+        auto expected = change / (p * variance);
+        if (abs(cooksDistances[i] - expected) > 0.001 * max(1.0, expected))
+        {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+int QuadraticRegression::UnitTest11(vector<PointF>& points)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    // Unit test #11:  Downdating labels the outliers Recalculate labels      //
+    ////////////////////////////////////////////////////////////////////////////
+
+    // The consensus on the points of each of the tests above, refit by downdating the inliers' summations, 
+    // should remove the same outliers in the same order as recalculating the summations from the remaining 
+    // points, and end at the same average regression error to rounding.
+
+    QuadraticConsensusModel& (*tests[])(vector<PointF>&) = { UnitTestA2, UnitTest1, UnitTest2, UnitTest3, UnitTest4, UnitTest5,
+        UnitTest6, UnitTest7, UnitTest8, UnitTest9 };
+    for (auto test : tests)
+    {
+        auto independentVariable = static_cast<QuadraticModel&>(*test(points).model).independentVariable;
+
+        QuadraticConsensusModel recalculated(independentVariable);
+        recalculated.refitMethod = RegressionConsensusModel::RefitMethod::Recalculate;
+        auto status = recalculated.Calculate(points, DEFAULT_SENSITIVITY);
+
+        QuadraticConsensusModel downdated(independentVariable);
+        downdated.refitMethod = RegressionConsensusModel::RefitMethod::Downdate;
+        if (downdated.Calculate(points, DEFAULT_SENSITIVITY) != status || downdated.model->ValidRegressionModel != recalculated.model->ValidRegressionModel)
+        {
+            return 1;
+        }
+
+        if (downdated.outlierIndices != recalculated.outlierIndices)
+        {
+            return 2;
+        }
+
+        if (abs(downdated.model->AverageRegressionError - recalculated.model->AverageRegressionError) > 0.0001f * max(1.0f, recalculated.model->AverageRegressionError))
+        {
+            return 3;
+        }
+    }
+
+    return 0;
+}
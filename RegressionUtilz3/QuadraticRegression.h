@@ -42,7 +42,7 @@ protected:
     const static float DEFAULT_SENSITIVITY;
 
 public:
-    class QuadraticModel : public PolynomialModel
+    class QuadraticModel final : public PolynomialModel
     {
     public:
         double b1;  // Coefficients of   y = b1 + b2 * x + b3 * x^2   -OR-   x = b1 + b2 * y + b3 * y^2
@@ -67,6 +67,7 @@ public:
             b1 = copy.b1;
             b2 = copy.b2;
             b3 = copy.b3;
+            summations = copy.summations;
         }
 
         RegressionModel* Clone() override
@@ -82,6 +83,7 @@ public:
             b1 = other.b1;
             b2 = other.b2;
             b3 = other.b3;
+            summations = other.summations;
 
             return *this;
         }
@@ -90,6 +92,8 @@ public:
 
         float ModeledX(float y) override;
 
+        void CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors) override;
+
     protected:
         class QuadraticSummations : public Summations
         {
@@ -99,10 +103,27 @@ public:
             double x3;
             double x2y;   // (i.e.  SUM(x^2*y))
             double x4;
+            double y2;
         };
 
+        QuadraticSummations summations;
+
     public:
-        Summations* CalculateSummations(vector<PointF> points) override;
+        void CalculateSummations(const PointCloud2D& points, Summations& sums) override;
+
+        Summations& ModelSummations() override
+        {
+            return summations;
+        }
+
+        void UpdateSummations(Summations& sums, PointF point, double weight) override;
+
+        void ShiftSummations(Summations& sums, double dx, double dy) override;
+
+        double CalculateResidualSumOfSquares(Summations& sums, PointF point, double weight) override;
+
+        void CalculateResidualSumsOfSquares(Summations& sums, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+            double* residualSumsOfSquares) override;
 
         void CalculateModel(Summations& sums) override;
 
@@ -121,13 +142,26 @@ public:
             outliers = vector<PointF>();
         }
 
-        QuadraticConsensusModel(const QuadraticConsensusModel& copy)
+        // Each consensus model owns (and deletes) its models, so a copy clones them
+        QuadraticConsensusModel(const QuadraticConsensusModel& copy) : RegressionConsensusModel()
         {
-            model = copy.model;
-            original = copy.original;
+            RegressionConsensusModel::operator=(copy);
+            model = copy.model->Clone();
+            original = copy.original->Clone();
+        }
 
-            inliers = copy.inliers;
-            outliers = copy.outliers;
+        QuadraticConsensusModel& operator=(const QuadraticConsensusModel& other)
+        {
+            if (this != &other)
+            {
+                delete model;
+                delete original;
+
+                RegressionConsensusModel::operator=(other);
+                model = other.model->Clone();
+                original = other.original->Clone();
+            }
+            return *this;
         }
 
         ~QuadraticConsensusModel()
@@ -138,9 +172,15 @@ public:
 
     protected:
         float CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide) override;
+
+        void ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex) override;
     };
 
-    static QuadraticConsensusModel& CalculateQuadraticRegressionConsensus(vector<PointF> points, enmIndependentVariable independentVariable = enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY);
+    static QuadraticConsensusModel& CalculateQuadraticRegressionConsensus(const vector<PointF>& points, enmIndependentVariable independentVariable = enmIndependentVariable::X, float sensitivityInPixels = DEFAULT_SENSITIVITY);
+
+    // Warm start from a prior consensus (e.g. of the previous frame), keeping its independent variable.  If the prior labeled 
+    // as many points, its inlier labels are the starting inliers (the points are taken to be in the same order).
+    static QuadraticConsensusModel& CalculateQuadraticRegressionConsensus(const vector<PointF>& points, QuadraticConsensusModel& prior, float sensitivityInPixels = DEFAULT_SENSITIVITY);
 
 public: // Unit tests
     static QuadraticConsensusModel& UnitTestA2(vector<PointF>& anscombe2);
@@ -153,4 +193,8 @@ public: // Unit tests
     static QuadraticConsensusModel& UnitTest7(vector<PointF>& points);
     static QuadraticConsensusModel& UnitTest8(vector<PointF>& points);
     static QuadraticConsensusModel& UnitTest9(vector<PointF>& points);
+
+    // Checks that return 0 on success and non-zero on failure
+    static int UnitTest10(vector<PointF>& points);
+    static int UnitTest11(vector<PointF>& points);
 };
\ No newline at end of file
@@ -1,181 +1,638 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+
 #include "RegressionConsensusModel.h"
 
-PointF RegressionConsensusModel::GetPositiveCandidate(vector<PointF> points, RegressionModel& model, int& index, vector<PointF>& pointsWithoutCandidate)
+void RegressionConsensusModel::GetCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex)
 {
-    if (points.size() <= model.MinimumPoints)
+    if (numberOfInliers <= model.MinimumPoints)
     {
-        index = -1;
-        pointsWithoutCandidate = vector<PointF>();
-        return PointF();
+        positiveIndex = negativeIndex = influenceIndex = -1;
+        return;
     }
 
-    auto maxRegressionError = -99999999.9f;
-    index = 0;
-    for (auto i = 0; i < points.size(); ++i)
+    ScanCandidates(model, positiveIndex, negativeIndex, influenceIndex);
+}
+
+void RegressionConsensusModel::ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex)
+{
+    vector<RegressionModel::PointInfluence> cooksDistance;
+    auto useCooksDistance = influenceError == InfluenceError::CooksDistance && model.CalculateInfluence(dataPoints, cooksDistance) == 0;
+
+    ScanCandidates(
+        [&](int, PointF point, bool& pointOnPositiveSide) { return CalculateError(model, point, pointOnPositiveSide); },
+        [&](int i, PointF point) { return useCooksDistance ? cooksDistance[i].cooksDistance : CalculateDistanceInfluence(influenceError, point, model); },
+        positiveIndex, negativeIndex, influenceIndex);
+}
+
+// The least squares solution is closed-form in the summations, so the residual sum of squares without any one 
+// point costs O(1).  Scoring every inlier finds the removal that best improves the fit in O(N).
+int RegressionConsensusModel::GetExhaustiveCandidate(RegressionModel& model)
+{
+    if (numberOfInliers <= model.MinimumPoints)
     {
-        auto point = points[i];
-        bool pointOnPositiveSide;
-        auto error = CalculateError(model, point, pointOnPositiveSide);
+        return -1;
+    }
 
-        if (pointOnPositiveSide)
+    // One virtual call for all the inliers
+    residualSumsOfSquares.resize(dataPoints.Count());
+    model.CalculateResidualSumsOfSquares(model.ModelSummations(), dataPoints, inlierMask, -1.0, residualSumsOfSquares.data());
+
+    auto minimumResidualSumOfSquares = 99999999.9;
+    auto index = -1;
+    for (auto i = 0; i < dataPoints.Count(); ++i)
+    {
+        if (inlierMask[i] && residualSumsOfSquares[i] < minimumResidualSumOfSquares)
         {
-            if (error > maxRegressionError)
-            {
-                maxRegressionError = error;
-                index = i;
-            }
+            minimumResidualSumOfSquares = residualSumsOfSquares[i];
+            index = i;
         }
     }
 
-    pointsWithoutCandidate = vector<PointF>(points);
-    pointsWithoutCandidate.erase(pointsWithoutCandidate.begin() + index);
+    // -1 if no removal leaves a valid model
+    return index;
+}
 
-    return points[index];
+int RegressionConsensusModel::GetBatchSize(float sensitivity)
+{
+    auto averageRegressionError = model->AverageRegressionError;
+    if (averageRegressionError <= 0.0f)
+    {
+        return 0;
+    }
+
+    auto excess = min(max((averageRegressionError - sensitivity) / averageRegressionError, 0.0f), 1.0f);
+    auto batchSize = (int)(batchFraction * numberOfInliers * excess);
+    return min(batchSize, numberOfInliers - model->MinimumPoints);
 }
 
-PointF RegressionConsensusModel::GetNegativeCandidate(vector<PointF> points, RegressionModel& model, int& index, vector<PointF>& pointsWithoutCandidate)
+bool RegressionConsensusModel::RemoveBatch(int batchSize, float sensitivity, PointCloud2D& pointsWithoutBatch)
 {
-    if (points.size() <= model.MinimumPoints)
+    // Rank the inliers by their regression error, from the cached residuals when they line up with dataPoints.  
+    // Only points with an error above the sensitivity are batch candidates.
+    auto cached = (int)model->residuals.size() == dataPoints.Count();
+    auto errors = vector<float>(dataPoints.Count(), 0.0f);
+    auto candidates = vector<int>();
+    candidates.reserve(numberOfInliers);
+    for (auto i = 0; i < dataPoints.Count(); ++i)
     {
-        index = -1;
-        pointsWithoutCandidate = vector<PointF>();
-        return PointF();
+        if (inlierMask[i] && dataPoints.IsValid(i))
+        {
+            errors[i] = cached ? std::abs(model->residuals[i]) : model->CalculateRegressionError(dataPoints[i]);
+            if (errors[i] > sensitivity)
+            {
+                candidates.push_back(i);
+            }
+        }
+    }
+
+    batchSize = min(batchSize, (int)candidates.size());
+    if (batchSize <= 1)
+    {
+        return false;
     }
 
-    auto maxRegressionError = -99999999.9f;
-    index = 0;
-    for (auto i = 0; i < points.size(); ++i)
+    // The largest errors first (on a tie, the lower index)
+    partial_sort(candidates.begin(), candidates.begin() + batchSize, candidates.end(), [&](int a, int b)
+    {
+        return errors[a] > errors[b] || (errors[a] == errors[b] && a < b);
+    });
+
+    // The errors above are from the model before the batch, and the refit without the batch fits the remaining 
+    // points more closely, so a batch can take the average error well below the sensitivity.  If the whole batch 
+    // overshoots, binary search for the largest batch whose refit keeps the average error at or above the 
+    // sensitivity (each refit is O(1) to downdate and O(N) to score), leaving the single removals to finish.
+    auto modelWithoutBatch = RefitWithoutBatch(candidates, batchSize, pointsWithoutBatch);
+    if (!modelWithoutBatch->ValidRegressionModel || modelWithoutBatch->AverageRegressionError < sensitivity)
     {
-        auto point = points[i];
-        bool pointOnPositiveSide;
-        auto error = CalculateError(model, point, pointOnPositiveSide);
+        delete modelWithoutBatch;
+        modelWithoutBatch = nullptr;
 
-        if (!pointOnPositiveSide)
+        auto low = 1;
+        auto high = batchSize;
+        while (high - low > 1)
         {
-            if (error > maxRegressionError)
+            auto size = low + (high - low) / 2;
+            auto modelWithoutSize = RefitWithoutBatch(candidates, size, pointsWithoutBatch);
+            if (modelWithoutSize->ValidRegressionModel && modelWithoutSize->AverageRegressionError >= sensitivity)
+            {
+                delete modelWithoutBatch;
+                modelWithoutBatch = modelWithoutSize;
+                low = size;
+            }
+            else
             {
-                maxRegressionError = error;
-                index = i;
+                delete modelWithoutSize;
+                high = size;
             }
         }
+
+        if (modelWithoutBatch == nullptr)
+        {
+            return false;
+        }
+        batchSize = low;
+    }
+
+    for (auto k = 0; k < batchSize; ++k)
+    {
+        inlierMask[candidates[k]] = 0;
     }
 
-    pointsWithoutCandidate = vector<PointF>(points);
-    pointsWithoutCandidate.erase(pointsWithoutCandidate.begin() + index);
+    numberOfInliers -= batchSize;
+    outlierIndices.insert(outlierIndices.end(), candidates.begin(), candidates.begin() + batchSize);
+    delete model;
+    model = modelWithoutBatch;
 
-    return points[index];
+    return true;
 }
 
-
-PointF RegressionConsensusModel::GetInfluenceCandidate(vector<PointF> points, RegressionModel& model, int& index, vector<PointF>& pointsWithoutCandidate)
+RegressionModel* RegressionConsensusModel::RefitWithoutBatch(const vector<int>& candidates, int batchSize, PointCloud2D& pointsWithoutBatch)
 {
-    if (points.size() <= model.MinimumPoints)
+    for (auto k = 0; k < batchSize; ++k)
     {
-        index = -1;
-        pointsWithoutCandidate = vector<PointF>();
-        return PointF();
+        inlierMask[candidates[k]] = 0;
     }
 
-    auto maximumInfluence = 0.0f;
-    index = 0;
-    for (auto i = 0; i < points.size(); ++i)
+    RegressionModel* modelWithoutBatch = model->Clone();
+    if (Downdating())
+    {
+        auto& sumWithoutBatch = modelWithoutBatch->ModelSummations();
+        for (auto k = 0; k < batchSize; ++k)
+        {
+            modelWithoutBatch->UpdateSummations(sumWithoutBatch, dataPoints[candidates[k]], -1.0);
+        }
+        modelWithoutBatch->RecenterSummations(sumWithoutBatch);
+        modelWithoutBatch->CalculateModel(sumWithoutBatch, dataPoints, inlierMask);
+    }
+    else
     {
-        auto point = points[i];
-        auto dx = point.X - model.bias.x;
-        auto dy = point.Y - model.bias.y;
+        GatherInliers(-1, pointsWithoutBatch);
+        modelWithoutBatch->CalculateModel(pointsWithoutBatch, dataPoints, inlierMask);
+    }
+
+    // Put the batch back
+    for (auto k = 0; k < batchSize; ++k)
+    {
+        inlierMask[candidates[k]] = 1;
+    }
 
-        float influence;
-        if (influenceError == InfluenceError::L1)
+    return modelWithoutBatch;
+}
+
+void RegressionConsensusModel::ReadmitOutliers(float sensitivity)
+{
+    auto readmissionError = readmissionFactor * sensitivity;
+    vector<int> readmitted;
+    while (!outlierIndices.empty())
+    {
+        readmitted.clear();
+        for (auto index : outlierIndices)
         {
-            influence = (float)abs(dx + dy);
+            if (dataPoints.IsValid(index) && model->CalculateRegressionError(dataPoints[index]) <= readmissionError)
+            {
+                readmitted.push_back(index);
+            }
         }
-        else // L2
+
+        if (readmitted.empty())
         {
-            influence = (float)(dx * dx + dy * dy);
+            // Fixed point
+            break;
         }
 
-        if (influence > maximumInfluence)
+        // The model's summations are those of the inliers, whichever refit method produced it
+        RegressionModel* modelWithPoints = model->Clone();
+        auto& sumWithPoints = modelWithPoints->ModelSummations();
+        for (auto index : readmitted)
         {
-            maximumInfluence = influence;
-            index = i;
+            modelWithPoints->UpdateSummations(sumWithPoints, dataPoints[index], 1.0);
+            inlierMask[index] = 1;
         }
+        modelWithPoints->RecenterSummations(sumWithPoints);
+        modelWithPoints->CalculateModel(sumWithPoints, dataPoints, inlierMask);
+
+        if (!modelWithPoints->ValidRegressionModel || modelWithPoints->AverageRegressionError > max(sensitivity, model->AverageRegressionError))
+        {
+            // Adding these points back would undo the consensus
+            for (auto index : readmitted)
+            {
+                inlierMask[index] = 0;
+            }
+
+            delete modelWithPoints;
+            break;
+        }
+
+        delete model;
+        model = modelWithPoints;
+        numberOfInliers += (int)readmitted.size();
+        outlierIndices.erase(remove_if(outlierIndices.begin(), outlierIndices.end(), [&](int index) { return inlierMask[index] != 0; }), outlierIndices.end());
     }
+}
 
-    pointsWithoutCandidate = vector<PointF>(points);
-    pointsWithoutCandidate.erase(pointsWithoutCandidate.begin() + index);
+void RegressionConsensusModel::GatherInliers(int candidateIndex, PointCloud2D& pointsWithoutCandidate)
+{
+    pointsWithoutCandidate.Assign(dataPoints, inlierMask, candidateIndex);
+}
 
-    return points[index];
+void RegressionConsensusModel::MaterializeInliersAndOutliers()
+{
+    inliers = vector<PointF>();
+    inliers.reserve(numberOfInliers);
+    for (auto i = 0; i < dataPoints.Count(); ++i)
+    {
+        if (inlierMask[i])
+        {
+            inliers.push_back(dataPoints[i]);
+        }
+    }
+
+    outliers = vector<PointF>();
+    outliers.reserve(outlierIndices.size());
+    for (auto index : outlierIndices)
+    {
+        outliers.push_back(dataPoints[index]);
+    }
 }
 
-float RegressionConsensusModel::RemovePointAndCalculateError(vector<PointF> pointsWithoutCandidate, RegressionModel& modelWithoutCandidate)
+// Recalculate the model from the inliers without the candidate.  The model is scored on dataPoints through the 
+// mask so its residuals line up with dataPoints for the next candidate search.
+float RegressionConsensusModel::RemovePointAndCalculateError(int candidateIndex, PointCloud2D& pointsWithoutCandidate, RegressionModel& modelWithoutCandidate)
 {
-    modelWithoutCandidate.CalculateModel(pointsWithoutCandidate);
+    GatherInliers(candidateIndex, pointsWithoutCandidate);
+    modelWithoutCandidate.CalculateModel(pointsWithoutCandidate, dataPoints, inlierMask, candidateIndex);
+    return modelWithoutCandidate.AverageRegressionError;
+}
+
+// Downdate the model's summations by the candidate point and re-solve
+float RegressionConsensusModel::RemovePointAndCalculateError(int candidateIndex, RegressionModel& modelWithoutCandidate)
+{
+    auto& sumWithoutCandidate = modelWithoutCandidate.ModelSummations();
+    modelWithoutCandidate.UpdateSummations(sumWithoutCandidate, dataPoints[candidateIndex], -1.0);
+    modelWithoutCandidate.RecenterSummations(sumWithoutCandidate);
+    modelWithoutCandidate.CalculateModel(sumWithoutCandidate, dataPoints, inlierMask, candidateIndex);
     return modelWithoutCandidate.AverageRegressionError;
 }
 
 // Derived class will use the appropriate least squares regression to initialize the model/original
 // Returns 0 on success, returns non-zero on failure
-int RegressionConsensusModel::Calculate(vector<PointF> points, float sensitivity)
+int RegressionConsensusModel::Calculate(const vector<PointF>& points, float sensitivity)
+{
+    return Calculate(PointCloud2D::View(points), sensitivity);
+}
+
+int RegressionConsensusModel::Calculate(const PointF* points, int count, float sensitivity)
+{
+    return Calculate(PointCloud2D::View(points, count), sensitivity);
+}
+
+int RegressionConsensusModel::Calculate(const PointCloud2D& points, float sensitivity)
 {
-    if (points.size() < model->MinimumPoints)
+    auto start = chrono::steady_clock::now();
+    auto count = points.Count();
+    if (count < model->MinimumPoints)
     {
         // Exit with error
-        return 1;
+        return TOO_FEW_POINTS;
     }
 
-    // Calculate the initial model.  Set the initial inliers and outliers (empty) lists.
-    inliers = points;
-    outliers = vector<PointF>();
-    model->CalculateModel(points);
+    // Calculate the initial model.  All points start as inliers.
+    dataPoints.Assign(points);
+    inlierMask = vector<unsigned char>(count, 1);
+    outlierIndices = vector<int>();
+    numberOfInliers = count;
+    model->CalculateModel(dataPoints);
+    delete original;
     original = model->Clone();
 
+    return RemoveOutliers(sensitivity, start, recordRemovalPath);
+}
+
+int RegressionConsensusModel::CalculateWarmStart(const vector<PointF>& points, float sensitivity, RegressionModel& prior, const vector<unsigned char>& priorInlierMask)
+{
+    auto start = chrono::steady_clock::now();
+    if ((int)points.size() < model->MinimumPoints)
+    {
+        // Exit with error
+        return TOO_FEW_POINTS;
+    }
+
+    auto useMask = priorInlierMask.size() == points.size();
+    if (!useMask && !prior.ValidRegressionModel)
+    {
+        // No usable prior
+        return Calculate(points, sensitivity);
+    }
+
+    // The original model is still the regression of all the points
+    dataPoints.Assign(PointCloud2D::View(points));
+    model->CalculateModel(dataPoints);
+    delete original;
+    original = model->Clone();
+
+    // Label the points with the prior, fit the prior inliers, and then re-admit or reject every point against 
+    // that fit before refitting
+    auto admissionError = admissionFactor * sensitivity;
+    inlierMask = useMask ? priorInlierMask : vector<unsigned char>(points.size(), 0);
+    PointCloud2D inlierPoints;
+    for (auto pass = 0; pass < 2; ++pass)
+    {
+        auto labelModel = pass == 0 ? &prior : model;
+        if (pass > 0 || !useMask)
+        {
+            for (auto i = 0; i < (int)points.size(); ++i)
+            {
+                inlierMask[i] = dataPoints.IsValid(i) && labelModel->CalculateRegressionError(dataPoints[i]) <= admissionError;
+            }
+        }
+
+        GatherInliers(-1, inlierPoints);
+        if (inlierPoints.Count() < model->MinimumPoints)
+        {
+            // The prior does not fit this input; start over from all the points
+            return Calculate(points, sensitivity);
+        }
+
+        model->CalculateModel(inlierPoints, dataPoints, inlierMask);
+        if (!model->ValidRegressionModel)
+        {
+            return Calculate(points, sensitivity);
+        }
+    }
+
+    numberOfInliers = 0;
+    outlierIndices = vector<int>();
+    for (auto i = 0; i < (int)points.size(); ++i)
+    {
+        if (inlierMask[i])
+        {
+            ++numberOfInliers;
+        }
+        else
+        {
+            outlierIndices.push_back(i);
+        }
+    }
+
+    // Continue with the usual removals from the warm-started inliers
+    return RemoveOutliers(sensitivity, start, false);
+}
+
+int RegressionConsensusModel::RemoveOutliers(float sensitivity, chrono::steady_clock::time_point start, bool recordPath)
+{
+    removalPath = vector<int>();
+    removalErrors = vector<float>(1, model->AverageRegressionError);
+    minimumRemovalErrors = vector<float>();
+
+    // When downdating, each candidate model is a copy of the model, carrying the summations of the inliers, and 
+    // the removed point is subtracted from them rather than recalculating them from the remaining points
+    const int NUMBER_OF_CANDIDATES = 3;
+    PointCloud2D pointsWithoutPoint[NUMBER_OF_CANDIDATES];
+    auto downdate = Downdating();
+
     // Keep removing candidate points until the model is lower than some average error threshold
-    while (model->AverageRegressionError > sensitivity && model->ValidRegressionModel)
+    auto removeBatches = removalMethod == RemovalMethod::Batch && !recordPath;
+    auto maximumOutliers = (int)(maximumOutlierFraction * dataPoints.Count());
+    auto iterations = 0;
+    auto status = SUCCESS;
+
+    // With a limit, a removal can leave a worse model than an earlier one, so keep the model with the lowest 
+    // average regression error (and how many outliers it had) to fall back to if a limit ends the removals
+    auto trackBest = !recordPath && (maximumIterations > 0 || maximumOutlierFraction < 1.0f || deadlineMilliseconds > 0.0);
+    RegressionModel* bestModel = nullptr;
+    auto bestNumberOfOutliers = 0;
+
+    while ((recordPath || model->AverageRegressionError > sensitivity) && model->ValidRegressionModel)
     {
-        int index1, index2, index3;
-        auto pointsWithoutPoint1 = vector<PointF>();
-        auto pointsWithoutPoint2 = vector<PointF>();
-        auto pointsWithoutPoint3 = vector<PointF>();
-        auto candidatePoint1 = GetPositiveCandidate(inliers, *model, index1, pointsWithoutPoint1);
-        auto candidatePoint2 = GetNegativeCandidate(inliers, *model, index2, pointsWithoutPoint2);
-        auto candidatePoint3 = GetInfluenceCandidate(inliers, *model, index3, pointsWithoutPoint3);
+        if (trackBest && (bestModel == nullptr || model->AverageRegressionError < bestModel->AverageRegressionError))
+        {
+            delete bestModel;
+            bestModel = model->Clone();
+            bestNumberOfOutliers = (int)outlierIndices.size();
+        }
+
+        // Stop early, keeping the model of the last iteration, if a limit has been reached
+        if (maximumIterations > 0 && iterations >= maximumIterations)
+        {
+            status = ITERATION_LIMIT;
+            break;
+        }
+
+        if ((int)outlierIndices.size() >= maximumOutliers)
+        {
+            status = OUTLIER_LIMIT;
+            break;
+        }
+
+        if (deadlineMilliseconds > 0.0 && chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= deadlineMilliseconds)
+        {
+            status = DEADLINE_REACHED;
+            break;
+        }
+
+        ++iterations;
+        if (removeBatches)
+        {
+            // Once a batch would be a single point (or a batch fails), switch to single removals to refine the inliers
+            auto batchSize = min(GetBatchSize(sensitivity), maximumOutliers - (int)outlierIndices.size());
+            removeBatches = batchSize > 1 && RemoveBatch(batchSize, sensitivity, pointsWithoutPoint[0]);
+            if (removeBatches)
+            {
+                continue;
+            }
+        }
 
-        if (candidatePoint1.IsEmpty || candidatePoint2.IsEmpty || candidatePoint3.IsEmpty || index1 < 0 || index2 < 0 || index3 < 0)
+        if (candidateSearch == CandidateSearch::Exhaustive)
+        {
+            // A single refit without the best candidate; the summations are downdated in place
+            auto index = GetExhaustiveCandidate(*model);
+            if (index < 0 || !dataPoints.IsValid(index))
+            {
+                // Exit with error
+                break;
+            }
+
+            RegressionModel* modelWithoutPoint = model->Clone();
+            RemovePointAndCalculateError(index, *modelWithoutPoint);
+            delete model;
+
+            inlierMask[index] = 0;
+            --numberOfInliers;
+            outlierIndices.push_back(index);
+            model = modelWithoutPoint;
+            removalErrors.push_back(model->AverageRegressionError);
+            continue;
+        }
+
+        int index[NUMBER_OF_CANDIDATES];
+        GetCandidates(*model, index[0], index[1], index[2]);
+
+        if (index[0] < 0 || index[1] < 0 || index[2] < 0 || !dataPoints.IsValid(index[0]) || !dataPoints.IsValid(index[1]) || !dataPoints.IsValid(index[2]))
         {
             // Exit with error
             break;
         }
 
-        RegressionModel* modelWithoutPoint1 = model->Clone();
-        RegressionModel* modelWithoutPoint2 = model->Clone();
-        RegressionModel* modelWithoutPoint3 = model->Clone();
-        auto newAverageError1 = RemovePointAndCalculateError(pointsWithoutPoint1, *modelWithoutPoint1);
-        auto newAverageError2 = RemovePointAndCalculateError(pointsWithoutPoint2, *modelWithoutPoint2);
-        auto newAverageError3 = RemovePointAndCalculateError(pointsWithoutPoint3, *modelWithoutPoint3);
+        RegressionModel* modelWithoutPoint[NUMBER_OF_CANDIDATES];
+        float newAverageError[NUMBER_OF_CANDIDATES];
+        for (auto k = 0; k < NUMBER_OF_CANDIDATES; ++k)
+        {
+            modelWithoutPoint[k] = model->Clone();
+        }
+
+        // Each candidate refits its own model (with its own summations or points buffer) and only reads the shared 
+        // points and mask, so the refits can run concurrently with the same results as running them in order
+        auto removePointAndCalculateError = [&](int k)
+        {
+            if (downdate)
+            {
+                newAverageError[k] = RemovePointAndCalculateError(index[k], *modelWithoutPoint[k]);
+            }
+            else
+            {
+                newAverageError[k] = RemovePointAndCalculateError(index[k], pointsWithoutPoint[k], *modelWithoutPoint[k]);
+            }
+        };
+
+        if (candidateEvaluation == CandidateEvaluation::Parallel && numberOfInliers >= parallelMinimumInliers)
+        {
+            future<void> refits[NUMBER_OF_CANDIDATES - 1];
+            for (auto k = 1; k < NUMBER_OF_CANDIDATES; ++k)
+            {
+                refits[k - 1] = async(launch::async, removePointAndCalculateError, k);
+            }
+
+            removePointAndCalculateError(0);
+            for (auto& refit : refits)
+            {
+                refit.get();
+            }
+        }
+        else
+        {
+            for (auto k = 0; k < NUMBER_OF_CANDIDATES; ++k)
+            {
+                removePointAndCalculateError(k);
+            }
+        }
         delete model;
 
-        if (newAverageError1 < newAverageError2 && newAverageError1 < newAverageError3)
+        // Keep the candidate with the lowest error (on a tie, the later candidate)
+        auto best = 0;
+        for (auto k = 1; k < NUMBER_OF_CANDIDATES; ++k)
         {
-            inliers = pointsWithoutPoint1;
-            outliers.push_back(candidatePoint1);
-            model = modelWithoutPoint1;
-            delete modelWithoutPoint2; delete modelWithoutPoint3;
+            if (newAverageError[k] <= newAverageError[best])
+            {
+                best = k;
+            }
         }
-        else if (newAverageError2 < newAverageError3)
+
+        inlierMask[index[best]] = 0;
+        --numberOfInliers;
+        outlierIndices.push_back(index[best]);
+        model = modelWithoutPoint[best];
+        removalErrors.push_back(model->AverageRegressionError);
+
+        for (auto k = 0; k < NUMBER_OF_CANDIDATES; ++k)
         {
-            inliers = pointsWithoutPoint2;
-            outliers.push_back(candidatePoint2);
-            model = modelWithoutPoint2;
-            delete modelWithoutPoint1; delete modelWithoutPoint3;
+            if (k != best)
+            {
+                delete modelWithoutPoint[k];
+            }
+        }
+    }
+
+    if (bestModel != nullptr && status != SUCCESS && bestModel->AverageRegressionError < model->AverageRegressionError)
+    {
+        // A limit ended the removals; go back to the best model by putting back the points removed after it
+        for (auto k = bestNumberOfOutliers; k < (int)outlierIndices.size(); ++k)
+        {
+            inlierMask[outlierIndices[k]] = 1;
+        }
+        numberOfInliers += (int)outlierIndices.size() - bestNumberOfOutliers;
+        outlierIndices.resize(bestNumberOfOutliers);
+
+        delete model;
+        model = bestModel;
+        bestModel = nullptr;
+    }
+    delete bestModel;
+
+    // The recorded path only removes points, so re-admission is left out while recording
+    if (readmitOutliers && !recordPath && model->ValidRegressionModel)
+    {
+        ReadmitOutliers(sensitivity);
+    }
+
+    if (recordPath)
+    {
+        removalPath = outlierIndices;
+        minimumRemovalErrors = removalErrors;
+        for (auto k = 1; k < (int)minimumRemovalErrors.size(); ++k)
+        {
+            minimumRemovalErrors[k] = min(minimumRemovalErrors[k], minimumRemovalErrors[k - 1]);
+        }
+        removalPathStatus = status;
+        return Requery(sensitivity);
+    }
+
+    MaterializeInliersAndOutliers();
+    return status;
+}
+
+int RegressionConsensusModel::Requery(float sensitivity)
+{
+    if (removalErrors.size() != removalPath.size() + 1 || minimumRemovalErrors.size() != removalErrors.size())
+    {
+        return NO_RECORDED_PATH;
+    }
+
+    // Calculate stops after the first removal whose model has an error at or below the sensitivity.  If the 
+    // path never got there, a limit stopped the recording, and like Calculate the step with the lowest error is kept.
+    auto status = SUCCESS;
+    auto firstBelow = lower_bound(minimumRemovalErrors.begin(), minimumRemovalErrors.end(), sensitivity, greater<float>());
+    if (firstBelow == minimumRemovalErrors.end())
+    {
+        firstBelow = lower_bound(minimumRemovalErrors.begin(), minimumRemovalErrors.end(), minimumRemovalErrors.back(), greater<float>());
+        status = removalPathStatus;
+    }
+    auto steps = (int)(firstBelow - minimumRemovalErrors.begin());
+
+    inlierMask.assign(dataPoints.Count(), 1);
+    outlierIndices.assign(removalPath.begin(), removalPath.begin() + steps);
+    for (auto index : outlierIndices)
+    {
+        inlierMask[index] = 0;
+    }
+    numberOfInliers = dataPoints.Count() - steps;
+
+    // Rebuild the model of that step from the initial model
+    delete model;
+    model = original->Clone();
+    if (steps > 0)
+    {
+        if (Downdating())
+        {
+            // The initial model carries the summations of all the points
+            auto& sum = model->ModelSummations();
+            for (auto index : outlierIndices)
+            {
+                model->UpdateSummations(sum, dataPoints[index], -1.0);
+            }
+            model->RecenterSummations(sum);
+            model->CalculateModel(sum, dataPoints, inlierMask);
         }
         else
         {
-            inliers = pointsWithoutPoint3;
-            outliers.push_back(candidatePoint3);
-            model = modelWithoutPoint3;
-            delete modelWithoutPoint1; delete modelWithoutPoint2;
+            PointCloud2D inlierPoints;
+            GatherInliers(-1, inlierPoints);
+            model->CalculateModel(inlierPoints, dataPoints, inlierMask);
         }
     }
 
-    return 0;
-}
\ No newline at end of file
+    MaterializeInliersAndOutliers();
+    return status;
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <chrono>
+#include <cmath>
 #include <vector>
 
 #include "PointF.cpp"
@@ -26,35 +28,292 @@ public:
     vector<PointF> outliers;
     vector<PointF>& Outliers = outliers;
 
+    // While calculating, the input points are kept unchanged, copied once into owned stride-1 arrays whose 
+    // validity bitmask stands in for IsEmpty, and membership is tracked by index.  The inliers and outliers 
+    // lists above are only filled in once Calculate finishes.
+    PointCloud2D dataPoints;
+    vector<unsigned char> inlierMask;       // 1 if dataPoints[i] is an inlier
+    vector<int> outlierIndices;             // Indices into dataPoints in the order they were removed
+    int numberOfInliers = 0;
+
+    enum class RefitMethod
+    {
+        Recalculate = 1,    // Each candidate model recalculates the bias and summations from its points, O(N)
+        Downdate = 2,       // Each candidate model subtracts its point from the inliers' summations, O(1)
+    };
+    RefitMethod refitMethod = RefitMethod::Recalculate;
+
+    enum class CandidateSearch
+    {
+        Heuristic = 1,      // Refit without each of the positive, negative, and influence candidates
+        Exhaustive = 2,     // Score the removal of every inlier by its downdated residual sum of squares
+    };                      //   (for the ellipse this is the algebraic, not the geometric, error)
+    CandidateSearch candidateSearch = CandidateSearch::Heuristic;
+
+    enum class InfluenceError
+    {
+        L1 = 1,
+        L2 = 2,
+        CooksDistance = 3,  // Exact leverage and Cook's distance from the model (falls back to L2 if unsupported)
+    };
+    InfluenceError influenceError = InfluenceError::L1;
+
+    enum class RemovalMethod
+    {
+        Single = 1,         // Remove one candidate per iteration
+        Batch = 2,          // Remove the inliers with the largest regression errors in batches with a single refit, then
+    };                      //   finish with single removals once the batch size drops to 1
+    RemovalMethod removalMethod = RemovalMethod::Single;
+
+    // The largest fraction of the inliers removed by one batch.  The batch is scaled down by how close the 
+    // average regression error is to the sensitivity:  k = batchFraction * inliers * (error - sensitivity) / error
+    float batchFraction = 0.1f;
+
+    enum class CandidateEvaluation
+    {
+        Serial = 1,         // Refit the 3 heuristic candidates one after the other
+        Parallel = 2,       // Refit the 3 heuristic candidates on separate threads (the same result as Serial)
+    };
+    CandidateEvaluation candidateEvaluation = CandidateEvaluation::Serial;
+
+    // With Parallel, smaller inlier sets are still refit serially since a thread costs more than a small refit
+    int parallelMinimumInliers = 2000;
+
+    // Limits that end Calculate before the average regression error reaches the sensitivity.  The model with the 
+    // lowest average regression error seen so far is kept, with its inliers and outliers, and Calculate returns 
+    // which limit was reached.
+    int maximumIterations = 0;                  // Iterations (a batch counts as 1); 0 for no limit
+    float maximumOutlierFraction = 1.0f;        // Fraction of the input points that may be labeled outliers
+    double deadlineMilliseconds = 0.0;          // Wall-clock time from the start of Calculate; 0 for no deadline
+
+    // Record the whole removal path.  Calculate keeps removing candidates past the sensitivity (down to the 
+    // minimum points or a limit) and then rewinds to the sensitivity; Requery can then rewind to any other 
+    // sensitivity without repeating the search.  The removal order does not depend on the sensitivity, except 
+    // for batches, so batch removal is not used while recording.  Recording makes a removal per point instead of 
+    // per outlier, so Calculate is slower by about the ratio of points to outliers (on 3000 points with 10% 
+    // outliers, about 15x with the heuristic search and 10x with the exhaustive one); each Requery is then O(N).
+    bool recordRemovalPath = false;
+
+    // With CalculateWarmStart, a point starts as an inlier if its regression error from the prior model (and 
+    // then from the model refit to those inliers) is within admissionFactor * sensitivity
+    float admissionFactor = 3.0f;
+
+    // After the removals, add back the outliers whose regression error from the final model is within 
+    // readmissionFactor * sensitivity (adding each to the summations in O(1)), refitting and repeating until no 
+    // more are added.  A set that would raise the average error above the sensitivity is not added.
+    bool readmitOutliers = false;
+    float readmissionFactor = 1.0f;
+
+    // The recorded path: removalPath is the order the points were removed in and removalErrors[k] is the average 
+    // regression error of the model after the first k removals (removalErrors[0] is the initial model)
+    vector<int> removalPath;
+    vector<float> removalErrors;
+
+    // Return codes of Calculate
+    const static int SUCCESS = 0;
+    const static int TOO_FEW_POINTS = 1;
+    const static int ITERATION_LIMIT = 2;
+    const static int OUTLIER_LIMIT = 3;
+    const static int DEADLINE_REACHED = 4;
+    const static int NO_RECORDED_PATH = 5;
+
     virtual RegressionConsensusModel& operator=(const RegressionConsensusModel& other)
     {
         model = other.model;
         original = other.original;
         inliers = other.inliers;
         outliers = other.outliers;
+        dataPoints = other.dataPoints;
+        inlierMask = other.inlierMask;
+        outlierIndices = other.outlierIndices;
+        numberOfInliers = other.numberOfInliers;
+        removalPath = other.removalPath;
+        removalErrors = other.removalErrors;
+        minimumRemovalErrors = other.minimumRemovalErrors;
+        removalPathStatus = other.removalPathStatus;
+        CopySettings(other);
 
         return *this;
     }
 
 protected:
+    // The running minimum of removalErrors (non-increasing, so a sensitivity can be found by binary search) and 
+    // the return code of the Calculate that recorded the path
+    vector<float> minimumRemovalErrors;
+    int removalPathStatus = SUCCESS;
+
+    // Copy the user-selectable settings (not the models or the points)
+    void CopySettings(const RegressionConsensusModel& other)
+    {
+        refitMethod = other.refitMethod;
+        candidateSearch = other.candidateSearch;
+        influenceError = other.influenceError;
+        removalMethod = other.removalMethod;
+        batchFraction = other.batchFraction;
+        candidateEvaluation = other.candidateEvaluation;
+        parallelMinimumInliers = other.parallelMinimumInliers;
+        maximumIterations = other.maximumIterations;
+        maximumOutlierFraction = other.maximumOutlierFraction;
+        deadlineMilliseconds = other.deadlineMilliseconds;
+        recordRemovalPath = other.recordRemovalPath;
+        admissionFactor = other.admissionFactor;
+        readmitOutliers = other.readmitOutliers;
+        readmissionFactor = other.readmissionFactor;
+    }
+
+    // The engine is not templated on the model type; it reaches the model through the virtual RegressionModel
+    // interface.  Clone, CalculateModel, UpdateSummations, and ScanCandidates stay virtual but are called a fixed
+    // number of times per removal, and the per-point loops (the ScanCandidates kernels,
+    // CalculateResidualSumsOfSquares, and the batch errors) make direct calls on the concrete, final model.  Only
+    // the default ScanCandidates, used when the model has no cached residuals, calls CalculateError per point.
     virtual float CalculateError(RegressionModel& model, PointF point, bool& pointOnPositiveSide) = 0;
 
-    PointF GetPositiveCandidate(vector<PointF> points, RegressionModel& model, int& index, vector<PointF>& pointsWithoutCandidate);
-    PointF GetNegativeCandidate(vector<PointF> points, RegressionModel& model, int& index, vector<PointF>& pointsWithoutCandidate);
+    // The candidate functions return an index into dataPoints (-1 if there is no candidate)
+    void GetCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex);
+    int GetExhaustiveCandidate(RegressionModel& model);
 
-    enum class InfluenceError
+    // Finds the positive, negative, and influence candidates in one pass over the points.  The default calls 
+    // CalculateError per point; a derived class can override it with a kernel specialized to its model.
+    virtual void ScanCandidates(RegressionModel& model, int& positiveIndex, int& negativeIndex, int& influenceIndex);
+
+    // The fused scan shared by the kernels
+    //   error(index, point, pointOnPositiveSide) returns the unsigned error of a point
+    //   influence(index, point) returns the influence of a point
+    // All three argmaxes are tracked at once with branchless selects so the loop body has no data dependent branches
+    template <typename ErrorFunction, typename InfluenceFunction>
+    void ScanCandidates(ErrorFunction error, InfluenceFunction influence, int& positiveIndex, int& negativeIndex, int& influenceIndex)
     {
-        L1 = 1,
-        L2 = 2,
-    };
-    InfluenceError influenceError = InfluenceError::L1;
+        auto size = dataPoints.Count();
+        auto xs = dataPoints.Xs();
+        auto ys = dataPoints.Ys();
+        auto first = 0;
+        while (first < size && !inlierMask[first])
+        {
+            ++first;
+        }
+
+        // Default to the first inlier
+        positiveIndex = negativeIndex = influenceIndex = first < size ? first : -1;
+        if (first >= size)
+        {
+            return;
+        }
+
+        auto maxPositiveError = -99999999.9f;
+        auto maxNegativeError = -99999999.9f;
+        auto maxInfluence = max(0.0f, influence(first, dataPoints[first]));
+        for (auto i = first; i < size; ++i)
+        {
+            PointF point(xs[i], ys[i]);
+            point.IsEmpty = !dataPoints.IsValid(i);
+            bool pointOnPositiveSide;
+            auto pointError = error(i, point, pointOnPositiveSide);
+            auto pointInfluence = influence(i, point);
+
+            bool isInlier = inlierMask[i] != 0;
+            bool newPositive = isInlier & pointOnPositiveSide & (pointError > maxPositiveError);
+            bool newNegative = isInlier & !pointOnPositiveSide & (pointError > maxNegativeError);
+            bool newInfluence = isInlier & (pointInfluence > maxInfluence);
+
+            maxPositiveError = newPositive ? pointError : maxPositiveError;
+            positiveIndex = newPositive ? i : positiveIndex;
+            maxNegativeError = newNegative ? pointError : maxNegativeError;
+            negativeIndex = newNegative ? i : negativeIndex;
+            maxInfluence = newInfluence ? pointInfluence : maxInfluence;
+            influenceIndex = newInfluence ? i : influenceIndex;
+        }
+    }
+
+    // True if the model's cached residuals are from scoring it on dataPoints (so a kernel can use them)
+    bool ResidualsAvailable(RegressionModel& model)
+    {
+        return model.ValidRegressionModel && (int)model.residuals.size() == dataPoints.Count();
+    }
+
+    // The influence of each of dataPoints for the candidate scan, reused between iterations
+    vector<float> influences;
+
+    // The residual sum of squares without each of dataPoints for the exhaustive search, reused between iterations
+    vector<double> residualSumsOfSquares;
+
+    // Fill influences with the Cook's distance of each of dataPoints from the model, in one pass.  Returns false 
+    // if the model does not provide it.
+    bool CalculateCooksDistances(RegressionModel& model)
+    {
+        influences.resize(dataPoints.Count());
+        return model.CalculateCooksDistances(dataPoints, influences.data()) == 0;
+    }
+
+    // The L1 or L2 distance of a point from the bias (center) of the model
+    static float CalculateDistanceInfluence(InfluenceError influenceError, PointF point, RegressionModel& model)
+    {
+        auto dx = point.X - model.bias.x;
+        auto dy = point.Y - model.bias.y;
+        if (influenceError == InfluenceError::L1)
+        {
+            return (float)abs(dx + dy);
+        }
+        else // L2 (or the fallback for CooksDistance)
+        {
+            return (float)(dx * dx + dy * dy);
+        }
+    }
+
+    // The number of points the next batch removes (a batch of 1 or less means finish with single removals)
+    int GetBatchSize(float sensitivity);
+
+    // Remove up to batchSize inliers with the largest regression errors (above the sensitivity), fewer if the 
+    // refit without them would have an average regression error below the sensitivity.  Returns false (leaving 
+    // the inliers, model, and summations unchanged) if fewer than 2 points can be removed that way.
+    bool RemoveBatch(int batchSize, float sensitivity, PointCloud2D& pointsWithoutBatch);
+
+    // A new model refit without the first batchSize candidates (the inlier mask is left unchanged)
+    RegressionModel* RefitWithoutBatch(const vector<int>& candidates, int batchSize, PointCloud2D& pointsWithoutBatch);
+
+    // Copy the inliers, leaving out the candidate, into a buffer whose storage is reused between iterations
+    void GatherInliers(int candidateIndex, PointCloud2D& pointsWithoutCandidate);
 
-    PointF GetInfluenceCandidate(vector<PointF> points, RegressionModel& model, int& index, vector<PointF>& pointsWithoutCandidate);
+    // Copy the inliers and outliers lists out of dataPoints
+    void MaterializeInliersAndOutliers();
 
-    float RemovePointAndCalculateError(vector<PointF> pointsWithoutCandidate, RegressionModel& modelWithoutCandidate);
+    float RemovePointAndCalculateError(int candidateIndex, PointCloud2D& pointsWithoutCandidate, RegressionModel& modelWithoutCandidate);
+    float RemovePointAndCalculateError(int candidateIndex, RegressionModel& modelWithoutCandidate);
+
+    // True if candidate models are refit by downdating the summations they carry instead of recalculating them
+    bool Downdating()
+    {
+        return refitMethod == RefitMethod::Downdate || candidateSearch == CandidateSearch::Exhaustive;
+    }
+
+    // Add back the outliers the model fits, to a fixed point
+    void ReadmitOutliers(float sensitivity);
+
+    // Remove candidates from the current inliers until the model is within the sensitivity (or a limit is reached)
+    int RemoveOutliers(float sensitivity, chrono::steady_clock::time_point start, bool recordPath);
 
 public:
     // Derived class will use the appropriate least squares regression to initialize the model/original
-    // Returns 0 on success, returns non-zero on failure
-    int Calculate(vector<PointF> points, float sensitivity);
+    // Returns SUCCESS (0) on success, TOO_FEW_POINTS on failure, or the limit that stopped the iterations early
+    int Calculate(const vector<PointF>& points, float sensitivity);
+
+    // As above, from a read-only view of count points or a PointCloud2D.  The points are copied once, into 
+    // dataPoints.
+    int Calculate(const PointF* points, int count, float sensitivity);
+    int Calculate(const PointCloud2D& points, float sensitivity);
+
+    // As Calculate, but starting from a prior such as the previous frame's consensus model.  The prior inliers 
+    // are the points within admissionFactor * sensitivity of the prior model (or priorInlierMask, if it labels 
+    // each point), refit and relabeled once before the usual removals, so an input close to the prior needs few 
+    // iterations.  Falls back to Calculate if the prior is not valid or leaves too few inliers.  Does not record 
+    // a removal path.
+    // The points are labeled one by one against the prior rather than removed one candidate at a time, so the 
+    // result can differ from a cold Calculate of the same points:  a point within the admission error of the 
+    // refit prior stays an inlier even if Calculate would have removed it, and the other way round.  The average 
+    // regression error still ends at or below the sensitivity, as with Calculate.
+    int CalculateWarmStart(const vector<PointF>& points, float sensitivity, RegressionModel& prior, const vector<unsigned char>& priorInlierMask = vector<unsigned char>());
+
+    // Rewind a recorded removal path to where Calculate would have stopped for this sensitivity, refitting the 
+    // model from the remaining inliers (or downdating the initial summations, as Calculate would have)
+    // Returns as Calculate would have, or NO_RECORDED_PATH if Calculate did not record a path
+    int Requery(float sensitivity);
 };
\ No newline at end of file
@@ -1,47 +1,100 @@
+#include <cmath>
+
 #include "RegressionModel.h"
 
 const double RegressionModel::EPSILON = 0.0001;       // Near-zero value to check for division-by-zero
 
-void RegressionModel::CalculateModel(vector<PointF> points)
+void RegressionModel::CalculateModel(const PointCloud2D& points)
 {
-    // Calculate the bias
-    bias = CalculateBias(points);
-    if (bias.x == 99999999.9)
+    if (!CalculateBiasAndSummations(points))
     {
-        ValidRegressionModel = false;
         return;
     }
 
-    // Remove the bias
-    auto pointsNoBias = RemoveBias(points, bias);
-    if (pointsNoBias.size() == 0)
+    CalculateModel(ModelSummations(), points);
+}
+
+void RegressionModel::CalculateModel(const PointF* points, int count)
+{
+    CalculateModel(PointCloud2D::View(points, count));
+}
+
+void RegressionModel::CalculateModel(const vector<PointF>& points)
+{
+    CalculateModel(PointCloud2D::View(points));
+}
+
+void RegressionModel::CalculateModel(const PointCloud2D& fitPoints, const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex)
+{
+    if (!CalculateBiasAndSummations(fitPoints))
     {
-        ValidRegressionModel = false;
         return;
     }
 
-    // Calculate the summations on the points after the bias has been removed
-    auto sum = CalculateSummations(pointsNoBias);
-    if (sum->N <= 0)
+    CalculateModel(ModelSummations(), points, mask, excludedIndex);
+}
+
+bool RegressionModel::CalculateBiasAndSummations(const PointCloud2D& points)
+{
+    if (points.Count() < 2)
+    {
+        ValidRegressionModel = false;
+        return false;
+    }
+
+    // Calculate the summations in a single pass about the first point, a shift inside the data that keeps the 
+    // powers small as removing the mean does
+    bias.x = points.X(0);
+    bias.y = points.Y(0);
+    auto& sum = ModelSummations();
+    CalculateSummations(points, sum);
+    if (sum.N <= 0)
     {
         ValidRegressionModel = false;
+        return false;
+    }
+
+    // Then move the bias to the mean and shift the summations to match, in O(1).  The mean is rounded to a 
+    // float, like the points, so that removing the bias from a point later lands in the same frame.
+    auto sumX = SummationsSwapped() ? sum.y : sum.x;
+    auto sumY = SummationsSwapped() ? sum.x : sum.y;
+    Bias mean;
+    mean.x = (float)(bias.x + sumX / (double)sum.N);
+    mean.y = (float)(bias.y + sumY / (double)sum.N);
+    ShiftSummations(sum, mean.x - bias.x, mean.y - bias.y);
+    bias = mean;
+
+    return true;
+}
+
+void RegressionModel::CalculateModel(Summations& sum, const PointCloud2D& points)
+{
+    if (!SolveModel(sum))
+    {
         return;
     }
 
-    CalculateModel(*sum);
-    if (!ValidRegressionModel)
+    CalculateAverageRegressionError(points);
+    if (AverageRegressionError >= 99999999.9f)
     {
+        ValidRegressionModel = false;
         return;
     }
-    delete sum;
+}
 
-    CalculateFeatures();
-    if (!ValidRegressionModel)
+void RegressionModel::CalculateModel(Summations& sum, const vector<PointF>& points)
+{
+    CalculateModel(sum, PointCloud2D::View(points));
+}
+
+void RegressionModel::CalculateModel(Summations& sum, const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex)
+{
+    if (!SolveModel(sum))
     {
         return;
     }
 
-    CalculateAverageRegressionError(points);
+    CalculateAverageRegressionError(points, mask, excludedIndex);
     if (AverageRegressionError >= 99999999.9f)
     {
         ValidRegressionModel = false;
@@ -49,10 +102,30 @@ void RegressionModel::CalculateModel(vector<PointF> points)
     }
 }
 
-RegressionModel::Bias RegressionModel::CalculateBias(vector<PointF> points)
+// Solve the model and calculate its features from the summations.  Returns true if the model is valid.
+bool RegressionModel::SolveModel(Summations& sum)
+{
+    if (sum.N <= 0)
+    {
+        ValidRegressionModel = false;
+        return false;
+    }
+
+    CalculateModel(sum);
+    if (!ValidRegressionModel)
+    {
+        return false;
+    }
+
+    CalculateFeatures();
+    return ValidRegressionModel;
+}
+
+RegressionModel::Bias RegressionModel::CalculateBias(const PointCloud2D& points)
 {
     Bias bias;
-    if (points.size() < 2)
+    auto count = points.Count();
+    if (count < 2)
     {
         // The minimum number of points to define an elliptical regression is 5
         bias.x = 9999999.9;
@@ -61,7 +134,7 @@ RegressionModel::Bias RegressionModel::CalculateBias(vector<PointF> points)
     }
 
     // Shorthand that better matches the math formulas
-    auto N = points.size();
+    auto N = count;
 
     //// Remove the bias (i.e. center the data at zero)
     //// Calculate the mean of a set of points
@@ -69,8 +142,8 @@ RegressionModel::Bias RegressionModel::CalculateBias(vector<PointF> points)
     auto meanY = 0.0;
     for (auto i = 0; i < N; ++i)
     {
-        meanX += points[i].X;
-        meanY += points[i].Y;
+        meanX += points.X(i);
+        meanY += points.Y(i);
     }
     meanX /= (float)N;
     meanY /= (float)N;
@@ -80,7 +153,17 @@ RegressionModel::Bias RegressionModel::CalculateBias(vector<PointF> points)
     return bias;
 }
 
-vector<PointF> RegressionModel::RemoveBias(vector<PointF> points, Bias bias)
+RegressionModel::Bias RegressionModel::CalculateBias(const PointF* points, int count)
+{
+    return CalculateBias(PointCloud2D::View(points, count));
+}
+
+RegressionModel::Bias RegressionModel::CalculateBias(const vector<PointF>& points)
+{
+    return CalculateBias(PointCloud2D::View(points));
+}
+
+vector<PointF> RegressionModel::RemoveBias(const vector<PointF>& points, Bias bias)
 {
     if (points.size() < 2)
     {
@@ -93,10 +176,11 @@ vector<PointF> RegressionModel::RemoveBias(vector<PointF> points, Bias bias)
     }
 
     // Shorthand that better matches the math formulas
-    auto N = points.size();
+    auto N = (int)points.size();
 
     //// Remove the mean from the set of points
     auto pointsNoBias = vector<PointF>();
+    pointsNoBias.reserve(N);
     for (auto i = 0; i < N; ++i)
     {
         auto x = points[i].X - (float)bias.x;
@@ -108,9 +192,10 @@ vector<PointF> RegressionModel::RemoveBias(vector<PointF> points, Bias bias)
 }
 
 // Calculate the average regression error
-float RegressionModel::CalculateAverageRegressionError(vector<PointF> points)
+float RegressionModel::CalculateAverageRegressionError(const PointCloud2D& points)
 {
-    if (points.size() == 0)
+    auto count = points.Count();
+    if (count == 0)
     {
         return 9999999.9f;
     }
@@ -120,21 +205,92 @@ float RegressionModel::CalculateAverageRegressionError(vector<PointF> points)
         return 9999999.9f;
     }
 
+    // Keep the residuals for the consensus candidate search
+    residuals.resize(count);
+    CalculateSignedRegressionErrors(points, residuals.data());
     auto sumRegressionErrors = 0.0f;
-    for (int i = 0; i < points.size(); ++i)
+    for (int i = 0; i < count; ++i)
     {
-        sumRegressionErrors += CalculateRegressionError(points[i]);
+        sumRegressionErrors += std::abs(residuals[i]);
     }
 
     // Save internally
-    AverageRegressionError = sumRegressionErrors / (float)points.size();
+    AverageRegressionError = sumRegressionErrors / (float)count;
 
     // Also return
     return AverageRegressionError;
 }
 
+float RegressionModel::CalculateAverageRegressionError(const PointF* points, int count)
+{
+    return CalculateAverageRegressionError(PointCloud2D::View(points, count));
+}
+
+float RegressionModel::CalculateAverageRegressionError(const vector<PointF>& points)
+{
+    return CalculateAverageRegressionError(PointCloud2D::View(points));
+}
+
+// Calculate the average regression error of the points whose mask is set, leaving out the excluded index
+float RegressionModel::CalculateAverageRegressionError(const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex)
+{
+    if (!ValidRegressionModel)
+    {
+        return 9999999.9f;
+    }
+
+    // Keep the residuals for the consensus candidate search.  Every point is scored in one batch and the points 
+    // left out by the mask are then zeroed.
+    residuals.resize(points.Count());
+    CalculateSignedRegressionErrors(points, residuals.data());
+    auto N = 0;
+    auto sumRegressionErrors = 0.0f;
+    for (int i = 0; i < points.Count(); ++i)
+    {
+        if (mask[i] && i != excludedIndex)
+        {
+            sumRegressionErrors += std::abs(residuals[i]);
+            ++N;
+        }
+        else
+        {
+            residuals[i] = 0.0f;
+        }
+    }
+
+    if (N == 0)
+    {
+        // No point is scored, so the model is not kept (CalculateModel checks for this value)
+        AverageRegressionError = 99999999.9f;
+        return AverageRegressionError;
+    }
+
+    // Save internally
+    AverageRegressionError = sumRegressionErrors / (float)N;
+
+    // Also return
+    return AverageRegressionError;
+}
+
+void RegressionModel::CalculateResidualSumsOfSquares(Summations& sum, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+    double* residualSumsOfSquares)
+{
+    for (auto i = 0; i < points.Count(); ++i)
+    {
+        residualSumsOfSquares[i] = mask[i] ? CalculateResidualSumOfSquares(sum, points[i], weight) : 99999999.9;
+    }
+}
+
+void RegressionModel::CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors)
+{
+    for (auto i = 0; i < points.Count(); ++i)
+    {
+        errors[i] = CalculateSignedRegressionError(points[i]);
+    }
+}
+
 // If the bias is known or a good estimate exists, remove it
-vector<PointF> RegressionModel::ZeroBiasPoints(vector<PointF> points, float xBias, float yBias)
+vector<PointF> RegressionModel::ZeroBiasPoints(const vector<PointF>& points, float xBias, float yBias)
 {
     if (points.size() == 0)
     {
@@ -145,7 +301,7 @@ vector<PointF> RegressionModel::ZeroBiasPoints(vector<PointF> points, float xBia
     auto newPoints = vector<PointF>();
 
     // Remove the bias
-    for (auto i = 0; i < points.size(); ++i)
+    for (auto i = 0; i < (int)points.size(); ++i)
     {
         newPoints.push_back(PointF(points[i].X - xBias, points[i].Y - yBias));
     }
@@ -154,7 +310,7 @@ vector<PointF> RegressionModel::ZeroBiasPoints(vector<PointF> points, float xBia
 }
 
 // In an attempt to remove unknown bias, zero mean a set of points
-vector<PointF> RegressionModel::ZeroMeanPoints(vector<PointF> points, float & xMean, float & yMean)
+vector<PointF> RegressionModel::ZeroMeanPoints(const vector<PointF>& points, float & xMean, float & yMean)
 {
     if (points.size() == 0)
     {
@@ -169,7 +325,7 @@ vector<PointF> RegressionModel::ZeroMeanPoints(vector<PointF> points, float & xM
     auto newPoints = vector<PointF>();
 
     // Calculate the summations
-    for (auto i = 0; i < points.size(); ++i)
+    for (auto i = 0; i < (int)points.size(); ++i)
     {
         xSum += points[i].X;
         ySum += points[i].Y;
@@ -178,7 +334,7 @@ vector<PointF> RegressionModel::ZeroMeanPoints(vector<PointF> points, float & xM
     yMean = ySum / (float)points.size();
 
     // Zero the means
-    for (auto i = 0; i < points.size(); ++i)
+    for (auto i = 0; i < (int)points.size(); ++i)
     {
         newPoints.push_back(PointF(points[i].X - xMean, points[i].Y - yMean));
     }
@@ -1,7 +1,7 @@
 #pragma once
 #include <vector>
 
-#include "PointF.cpp"
+#include "PointCloud2D.h"
 
 using namespace std;
 
@@ -23,6 +23,7 @@ public:
     {
         ValidRegressionModel = false;
         averageRegressionError = 99999999.9f;
+        residualSumOfSquares = 99999999.9;
         bias.x = 0;
         bias.y = 0;
         MinimumPoints = 2;
@@ -34,16 +35,20 @@ public:
     {
         ValidRegressionModel = copy.ValidRegressionModel;
         averageRegressionError = copy.AverageRegressionError;
+        residualSumOfSquares = copy.residualSumOfSquares;
         bias = copy.bias;
         MinimumPoints = copy.MinimumPoints;
     }
 
+    virtual ~RegressionModel() = default;
+
     virtual RegressionModel* Clone() = 0;
 
     virtual RegressionModel& operator=(const RegressionModel& other)
     {
         ValidRegressionModel = other.ValidRegressionModel;
         averageRegressionError = other.AverageRegressionError;
+        residualSumOfSquares = other.residualSumOfSquares;
         bias = other.bias;
         MinimumPoints = other.MinimumPoints;
 
@@ -56,6 +61,15 @@ public:
     float averageRegressionError;
     float& AverageRegressionError = averageRegressionError;
 
+    // The least squares objective of the last solve, calculated in closed form from the summations
+    double residualSumOfSquares;
+
+    // The signed regression error of each point from the last time the model was scored, indexed like the 
+    // scored points (0 for points left out by the mask).  Filled in by CalculateAverageRegressionError so that 
+    // the consensus candidate search can reuse the residuals instead of evaluating them again.  Not copied with 
+    // the model: copies are made to be refit (or, in CalculateResidualSumOfSquares, to be solved in O(1)).
+    vector<float> residuals;
+
     struct Bias
     {
         double x;
@@ -87,22 +101,171 @@ public:
         }
     };
 
-    virtual Summations* CalculateSummations(vector<PointF> points) = 0;
+    // Each model keeps the fixed-size summations of its last fit as a member, so fitting does not allocate and 
+    // a copy of the model carries its summations (the consensus downdates a copy's summations in place)
+    virtual Summations& ModelSummations() = 0;
+
+    // Calculate the summations of the points, removing the model's bias from each point as it is read (the 
+    // same way UpdateSummations does) rather than from a copy of the points
+    virtual void CalculateSummations(const PointCloud2D& points, Summations& sum) = 0;
+
+    // Add (weight = 1) or remove (weight = -1) a single point's contribution to the summations in O(1).
+    // The point is in the original coordinates; the model's bias is removed before the update.
+    virtual void UpdateSummations(Summations& sum, PointF point, double weight) = 0;
+
+    // Move the origin of the summations by (dx, dy) in the original coordinates, in O(1) by the binomial 
+    // expansion of each power, so that they become the summations of the points less (dx, dy).  The bias is 
+    // not changed.
+    virtual void ShiftSummations(Summations& sum, double dx, double dy) = 0;
+
+    // Move the bias to the mean of the summations' points and shift the summations to match, in O(1).
+    // Only needed by models whose solution depends on the bias; the polynomial models are shift-invariant.
+    virtual void RecenterSummations(Summations&)
+    {
+    }
 
     virtual void CalculateModel(Summations& sum) = 0;
 
-    void CalculateModel(vector<PointF> points);
+    // The fitting and scoring entry points take a read-only view of the caller's points (a PointCloud2D, or a 
+    // pointer and a count or a vector by reference, which are viewed in place) and make no copy of them
+    void CalculateModel(const PointCloud2D& points);
+    void CalculateModel(const PointF* points, int count);
+    void CalculateModel(const vector<PointF>& points);
+
+    // Solve the model from existing summations (e.g. after UpdateSummations) and score it on the points
+    void CalculateModel(Summations& sum, const PointCloud2D& points);
+    void CalculateModel(Summations& sum, const vector<PointF>& points);
+
+    // As above, scoring only the points whose mask is set (and leaving out the excluded index, if any)
+    void CalculateModel(Summations& sum, const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex = -1);
+
+    // Fit the model to fitPoints (the masked points, gathered) and score it on the points whose mask is set
+    void CalculateModel(const PointCloud2D& fitPoints, const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex = -1);
+
+    // The residual sum of squares of this model refit with the point added (weight = 1) or removed 
+    // (weight = -1), in O(1).  Neither the model nor the summations are changed.
+    virtual double CalculateResidualSumOfSquares(Summations& sum, PointF point, double weight) = 0;
 
-    static Bias CalculateBias(vector<PointF> points);
-    static vector<PointF> RemoveBias(vector<PointF> points, Bias bias);
-    float CalculateAverageRegressionError(vector<PointF> points);
+    // CalculateResidualSumOfSquares of each point whose mask is set, written to residualSumsOfSquares (one per 
+    // point, 99999999.9 where the mask is not set).  The default makes a virtual call per point; the models 
+    // override it so that one virtual call covers all the points and the per-point calls are direct.
+    virtual void CalculateResidualSumsOfSquares(Summations& sum, const PointCloud2D& points, const vector<unsigned char>& mask, double weight,
+        double* residualSumsOfSquares);
+
+    static Bias CalculateBias(const PointCloud2D& points);
+    static Bias CalculateBias(const PointF* points, int count);
+    static Bias CalculateBias(const vector<PointF>& points);
+    static vector<PointF> RemoveBias(const vector<PointF>& points, Bias bias);
+    float CalculateAverageRegressionError(const PointCloud2D& points);
+    float CalculateAverageRegressionError(const PointF* points, int count);
+    float CalculateAverageRegressionError(const vector<PointF>& points);
+    float CalculateAverageRegressionError(const PointCloud2D& points, const vector<unsigned char>& mask, int excludedIndex = -1);
 
     // Calculate the single-point regression error
     virtual float CalculateRegressionError(PointF point) = 0;
 
+    // The single-point regression error with its sign giving the side of the model the point is on.  The 
+    // default is unsigned; a model that knows the side for free overrides it.
+    virtual float CalculateSignedRegressionError(PointF point)
+    {
+        return CalculateRegressionError(point);
+    }
+
+    // The signed regression error of every point, written to errors (one per point).  This is what scores a 
+    // model; the default calls CalculateSignedRegressionError per point, and a model overrides it with a loop 
+    // that does not make a virtual call per point.
+    virtual void CalculateSignedRegressionErrors(const PointCloud2D& points, float* errors);
+
+    // Regression diagnostics of a single point with respect to the least squares fit
+    struct PointInfluence
+    {
+        float leverage;                 // Diagonal of the hat matrix
+        float studentizedResidual;      // Residual divided by its estimated standard deviation
+        float cooksDistance;            // Change in the fit if the point were removed
+    };
+
+    // Calculate the diagnostics of every point in one pass, reusing the solved normal equations.
+    // Returns 0 on success, returns non-zero on failure (or if the model does not support diagnostics).
+    virtual int CalculateInfluence(const PointCloud2D&, vector<PointInfluence>& influence)
+    {
+        influence = vector<PointInfluence>();
+        return 1;
+    }
+
+    // The Cook's distance of every point, written to distances (one per point), in one pass.
+    // Returns 0 on success, returns non-zero on failure (or if the model does not support diagnostics).
+    virtual int CalculateCooksDistances(const PointCloud2D&, float*)
+    {
+        return 1;
+    }
+
     // If the bias is known or a good estimate exists, remove it
-    static vector<PointF> ZeroBiasPoints(vector<PointF> points, float xBias, float yBias);
+    static vector<PointF> ZeroBiasPoints(const vector<PointF>& points, float xBias, float yBias);
 
     // In an attempt to remove unknown bias, zero mean a set of points
-    static vector<PointF> ZeroMeanPoints(vector<PointF> points, float& xMean, float& yMean);
+    static vector<PointF> ZeroMeanPoints(const vector<PointF>& points, float& xMean, float& yMean);
+
+protected:
+    bool SolveModel(Summations& sum);
+
+    // Calculate the bias (the mean) and the model's summations of the points in a single pass over them.
+    // Returns false (and an invalid model) on failure.
+    bool CalculateBiasAndSummations(const PointCloud2D& points);
+
+    // True if the model's summations are of the swapped coordinates (x and y exchanged, as a polynomial with a y 
+    // independent variable keeps them), so that Summations::x is SUM(y) and Summations::y is SUM(x)
+    virtual bool SummationsSwapped()
+    {
+        return false;
+    }
+
+    // Shared implementation of CalculateResidualSumOfSquares; the model and summations are passed by value
+    // so the update and solve happen on stack copies of the concrete types
+    template <class Model, class ModelSummations>
+    static double UpdatedResidualSumOfSquares(Model model, ModelSummations sum, PointF point, double weight)
+    {
+        return RefitResidualSumOfSquares(model, sum, point, weight);
+    }
+
+    // Shared implementation of CalculateResidualSumsOfSquares for the models that refit a copy.  The concrete 
+    // model (a final class) is a template parameter, so the update and solve are direct calls the compiler can 
+    // inline, and a single working copy of the model is refit for every point: a refit overwrites the solution 
+    // and, when it recenters, the bias, which is restored for each point.
+    template <class Model, class ModelSummations>
+    static void UpdatedResidualSumsOfSquares(Model& model, ModelSummations& sum, const PointCloud2D& points, const vector<unsigned char>& mask,
+        double weight, double* residualSumsOfSquares)
+    {
+        Model working = model;
+        for (auto i = 0; i < points.Count(); ++i)
+        {
+            if (!mask[i])
+            {
+                residualSumsOfSquares[i] = 99999999.9;
+                continue;
+            }
+
+            working.bias = model.bias;
+            residualSumsOfSquares[i] = RefitResidualSumOfSquares(working, sum, points[i], weight);
+        }
+    }
+
+    // Update a copy of the summations, refit the model to them, and return its residual sum of squares
+    template <class Model, class ModelSummations>
+    static double RefitResidualSumOfSquares(Model& model, ModelSummations sum, PointF point, double weight)
+    {
+        model.UpdateSummations(sum, point, weight);
+        model.RecenterSummations(sum);
+        if (sum.N < model.MinimumPoints)
+        {
+            return 99999999.9;
+        }
+
+        model.CalculateModel(sum);
+        if (!model.ValidRegressionModel)
+        {
+            return 99999999.9;
+        }
+
+        return model.residualSumOfSquares;
+    }
 };
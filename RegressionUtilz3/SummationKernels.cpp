@@ -0,0 +1,810 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SummationKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SUMMATION_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+using namespace std;
+
+// The vector kernels are compiled for their instruction set and only called once the CPU is known to support it
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+// Kernels that must round as the scalar code does, with no multiply-add fused by the compiler (GCC fuses the 
+// vector intrinsics otherwise; MSVC and Clang do not)
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_CONTRACTION __attribute__((optimize("-ffp-contract=off")))
+#else
+#define NO_CONTRACTION
+#endif
+
+SummationKernels::InstructionSet SummationKernels::instructionSet = SummationKernels::Supported();
+
+const float SummationKernels::NO_CROSSING = -99999999.9f;
+
+SummationKernels::InstructionSet SummationKernels::Supported()
+{
+    static const InstructionSet supported = []()
+    {
+#if defined(SUMMATION_KERNELS_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return InstructionSet::Scalar;
+        }
+
+        // AVX and FMA in the CPU, and the AVX state saved by the operating system
+        __cpuid(info, 1);
+        auto fma = (info[2] & (1 << 12)) != 0;
+        auto osxsave = (info[2] & (1 << 27)) != 0;
+        auto avx = (info[2] & (1 << 28)) != 0;
+        if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return InstructionSet::Scalar;
+        }
+
+        __cpuidex(info, 7, 0);
+        auto avx2 = (info[1] & (1 << 5)) != 0;
+        auto avx512 = (info[1] & (1 << 16)) != 0 && (_xgetbv(0) & 0xE6) == 0xE6;
+        return avx512 ? InstructionSet::AVX512 : avx2 ? InstructionSet::AVX2 : InstructionSet::Scalar;
+#elif defined(SUMMATION_KERNELS_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return InstructionSet::AVX512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return InstructionSet::AVX2;
+        }
+        return InstructionSet::Scalar;
+#else
+        return InstructionSet::Scalar;
+#endif
+    }();
+
+    return supported;
+}
+
+// The instruction set to use: the setting, if the CPU supports it
+static SummationKernels::InstructionSet ActiveInstructionSet()
+{
+    auto supported = SummationKernels::Supported();
+    return SummationKernels::instructionSet < supported ? SummationKernels::instructionSet : supported;
+}
+
+// Accumulate the power sums of points [first, count) one point at a time
+static void PolynomialSumsScalar(const float* xs, const float* ys, int first, int count, int stride, float biasX, float biasY,
+    int degree, double* sumX, double* sumXY, double& sumY2)
+{
+    for (auto i = first; i < count; ++i)
+    {
+        auto x = (double)(xs[i * stride] - biasX);
+        auto y = (double)(ys[i * stride] - biasY);
+
+        auto power = x;
+        sumXY[0] += y;
+        for (auto k = 1; k <= 2 * degree; ++k)
+        {
+            sumX[k] += power;
+            if (k <= degree)
+            {
+                sumXY[k] += power * y;
+            }
+            power *= x;
+        }
+        sumY2 += y * y;
+    }
+}
+
+static void EllipseSumsScalar(const float* xs, const float* ys, int first, int count, int stride, float biasX, float biasY, double M[5][5])
+{
+    for (auto i = first; i < count; ++i)
+    {
+        auto x = (double)(xs[i * stride] - biasX);
+        auto y = (double)(ys[i * stride] - biasY);
+        auto xx = x * x;
+        auto xy = x * y;
+        auto yy = y * y;
+
+        M[1][0] += x;
+        M[0][1] += y;
+        M[2][0] += xx;
+        M[1][1] += xy;
+        M[0][2] += yy;
+        M[3][0] += x * xx;
+        M[2][1] += xx * y;
+        M[1][2] += x * yy;
+        M[0][3] += y * yy;
+        M[4][0] += xx * xx;
+        M[3][1] += xx * xy;
+        M[2][2] += xx * yy;
+        M[1][3] += xy * yy;
+        M[0][4] += yy * yy;
+    }
+}
+
+// The ellipse errors of points [first, count).  The roots are found as EllipticalRegression::QuadraticEquation 
+// finds them (a zero discriminant gives the same single root both ways) and the halves not crossed are selected 
+// to NO_CROSSING, without branching.
+static NO_CONTRACTION void EllipseErrorsScalar(const float* xs, const float* ys, int first, int count, int stride, const double k[6], double biasX, double biasY,
+    float* errors)
+{
+    auto a = k[0], b = k[1], c = k[2], d = k[3], e = k[4], f = k[5];
+    for (auto i = first; i < count; ++i)
+    {
+        auto X = xs[i * stride];
+        auto Y = ys[i * stride];
+        auto x = X - biasX;
+        auto y = Y - biasY;
+
+        // The y-values at x:  c y^2 + (b x + e) y + (a x^2 + d x + f) = 0
+        auto B = b * x + e;
+        auto C = a * x * x + d * x + f;
+        auto discriminant = B * B - 4 * c * C;
+        auto root = sqrt(discriminant > 0.0 ? discriminant : 0.0);
+        auto top = (float)((-B + root) / (2.0 * c)) + (float)biasY;
+        auto bottom = (float)((-B - root) / (2.0 * c)) + (float)biasY;
+        top = discriminant >= 0.0 ? top : SummationKernels::NO_CROSSING;
+        bottom = discriminant >= 0.0 ? bottom : SummationKernels::NO_CROSSING;
+        auto errorV = min(abs(top - Y), abs(bottom - Y));
+
+        // The x-values at y:  a x^2 + (b y + d) x + (c y^2 + e y + f) = 0
+        B = b * y + d;
+        C = c * y * y + e * y + f;
+        discriminant = B * B - 4 * a * C;
+        root = sqrt(discriminant > 0.0 ? discriminant : 0.0);
+        auto right = (float)((-B + root) / (2.0 * a)) + (float)biasX;
+        auto left = (float)((-B - root) / (2.0 * a)) + (float)biasX;
+        right = discriminant >= 0.0 ? right : SummationKernels::NO_CROSSING;
+        left = discriminant >= 0.0 ? left : SummationKernels::NO_CROSSING;
+        auto errorH = min(abs(right - X), abs(left - X));
+
+        errors[i] = min(errorV, errorH);
+    }
+}
+
+// The Sampson errors of points [first, count), in the operations and order of CalculateSampsonError
+static NO_CONTRACTION void EllipseSampsonErrorsScalar(const float* xs, const float* ys, int first, int count, int stride, const double k[6],
+    double biasX, double biasY, float* errors)
+{
+    auto a = k[0], b = k[1], c = k[2], d = k[3], e = k[4], f = k[5];
+    for (auto i = first; i < count; ++i)
+    {
+        auto x = xs[i * stride] - biasX;
+        auto y = ys[i * stride] - biasY;
+
+        auto Q = a * x * x + b * x * y + c * y * y + d * x + e * y + f;
+        auto gradientX = 2.0 * a * x + b * y + d;
+        auto gradientY = b * x + 2.0 * c * y + e;
+        errors[i] = (float)(abs(Q) / sqrt(gradientX * gradientX + gradientY * gradientY));
+    }
+}
+
+#if defined(SUMMATION_KERNELS_X86)
+
+static TARGET_AVX2 double HorizontalSum(__m256d v)
+{
+    auto sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+// Load 4 coordinates, less the bias, as doubles
+static TARGET_AVX2 __m256d Load4(const float* values, int i, int stride, __m128i index, __m128 bias)
+{
+    auto v = stride == 1 ? _mm_loadu_ps(values + i) : _mm_i32gather_ps(values + i * stride, index, 4);
+    return _mm256_cvtps_pd(_mm_sub_ps(v, bias));
+}
+
+// Load 8 coordinates, less the bias, as doubles
+static TARGET_AVX512 __m512d Load8(const float* values, int i, int stride, __m256i index, __m256 bias)
+{
+    auto v = stride == 1 ? _mm256_loadu_ps(values + i) : _mm256_i32gather_ps(values + i * stride, index, 4);
+    return _mm512_cvtps_pd(_mm256_sub_ps(v, bias));
+}
+
+// The polynomial power sums 4 points at a time.  Returns the number of points summed (a multiple of 4).
+template <int D>
+static TARGET_AVX2 int PolynomialSumsAVX2(const float* xs, const float* ys, int count, int stride, float biasX, float biasY,
+    double* sumX, double* sumXY, double& sumY2)
+{
+    __m256d accumulatorX[2 * D + 1];
+    __m256d accumulatorXY[D + 1];
+    auto accumulatorY2 = _mm256_setzero_pd();
+    for (auto k = 0; k <= 2 * D; ++k)
+    {
+        accumulatorX[k] = _mm256_setzero_pd();
+    }
+    for (auto k = 0; k <= D; ++k)
+    {
+        accumulatorXY[k] = _mm256_setzero_pd();
+    }
+
+    auto index = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+    auto bx = _mm_set1_ps(biasX);
+    auto by = _mm_set1_ps(biasY);
+    auto i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        auto x = Load4(xs, i, stride, index, bx);
+        auto y = Load4(ys, i, stride, index, by);
+
+        auto power = x;
+        accumulatorXY[0] = _mm256_add_pd(accumulatorXY[0], y);
+        for (auto k = 1; k <= 2 * D; ++k)
+        {
+            accumulatorX[k] = _mm256_add_pd(accumulatorX[k], power);
+            if (k <= D)
+            {
+                accumulatorXY[k] = _mm256_fmadd_pd(power, y, accumulatorXY[k]);
+            }
+            power = _mm256_mul_pd(power, x);
+        }
+        accumulatorY2 = _mm256_fmadd_pd(y, y, accumulatorY2);
+    }
+
+    for (auto k = 1; k <= 2 * D; ++k)
+    {
+        sumX[k] += HorizontalSum(accumulatorX[k]);
+    }
+    for (auto k = 0; k <= D; ++k)
+    {
+        sumXY[k] += HorizontalSum(accumulatorXY[k]);
+    }
+    sumY2 += HorizontalSum(accumulatorY2);
+
+    return i;
+}
+
+// The polynomial power sums 8 points at a time.  Returns the number of points summed (a multiple of 8).
+template <int D>
+static TARGET_AVX512 int PolynomialSumsAVX512(const float* xs, const float* ys, int count, int stride, float biasX, float biasY,
+    double* sumX, double* sumXY, double& sumY2)
+{
+    __m512d accumulatorX[2 * D + 1];
+    __m512d accumulatorXY[D + 1];
+    auto accumulatorY2 = _mm512_setzero_pd();
+    for (auto k = 0; k <= 2 * D; ++k)
+    {
+        accumulatorX[k] = _mm512_setzero_pd();
+    }
+    for (auto k = 0; k <= D; ++k)
+    {
+        accumulatorXY[k] = _mm512_setzero_pd();
+    }
+
+    auto index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride, 4 * stride, 5 * stride, 6 * stride, 7 * stride);
+    auto bx = _mm256_set1_ps(biasX);
+    auto by = _mm256_set1_ps(biasY);
+    auto i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto x = Load8(xs, i, stride, index, bx);
+        auto y = Load8(ys, i, stride, index, by);
+
+        auto power = x;
+        accumulatorXY[0] = _mm512_add_pd(accumulatorXY[0], y);
+        for (auto k = 1; k <= 2 * D; ++k)
+        {
+            accumulatorX[k] = _mm512_add_pd(accumulatorX[k], power);
+            if (k <= D)
+            {
+                accumulatorXY[k] = _mm512_fmadd_pd(power, y, accumulatorXY[k]);
+            }
+            power = _mm512_mul_pd(power, x);
+        }
+        accumulatorY2 = _mm512_fmadd_pd(y, y, accumulatorY2);
+    }
+
+    for (auto k = 1; k <= 2 * D; ++k)
+    {
+        sumX[k] += _mm512_reduce_add_pd(accumulatorX[k]);
+    }
+    for (auto k = 0; k <= D; ++k)
+    {
+        sumXY[k] += _mm512_reduce_add_pd(accumulatorXY[k]);
+    }
+    sumY2 += _mm512_reduce_add_pd(accumulatorY2);
+
+    return i;
+}
+
+template <int D>
+static int PolynomialSumsVector(SummationKernels::InstructionSet set, const float* xs, const float* ys, int count, int stride,
+    float biasX, float biasY, double* sumX, double* sumXY, double& sumY2)
+{
+    if (set == SummationKernels::InstructionSet::AVX512)
+    {
+        return PolynomialSumsAVX512<D>(xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+    }
+
+    return PolynomialSumsAVX2<D>(xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+}
+
+// The ellipse moments 4 points at a time.  Returns the number of points summed (a multiple of 4).
+static TARGET_AVX2 int EllipseSumsAVX2(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, double M[5][5])
+{
+    auto x1 = _mm256_setzero_pd(), y1 = _mm256_setzero_pd();
+    auto x2 = _mm256_setzero_pd(), xy = _mm256_setzero_pd(), y2 = _mm256_setzero_pd();
+    auto x3 = _mm256_setzero_pd(), x2y = _mm256_setzero_pd(), xy2 = _mm256_setzero_pd(), y3 = _mm256_setzero_pd();
+    auto x4 = _mm256_setzero_pd(), x3y = _mm256_setzero_pd(), x2y2 = _mm256_setzero_pd(), xy3 = _mm256_setzero_pd(), y4 = _mm256_setzero_pd();
+
+    auto index = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+    auto bx = _mm_set1_ps(biasX);
+    auto by = _mm_set1_ps(biasY);
+    auto i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        auto x = Load4(xs, i, stride, index, bx);
+        auto y = Load4(ys, i, stride, index, by);
+        auto xx = _mm256_mul_pd(x, x);
+        auto xY = _mm256_mul_pd(x, y);
+        auto yy = _mm256_mul_pd(y, y);
+
+        x1 = _mm256_add_pd(x1, x);
+        y1 = _mm256_add_pd(y1, y);
+        x2 = _mm256_add_pd(x2, xx);
+        xy = _mm256_add_pd(xy, xY);
+        y2 = _mm256_add_pd(y2, yy);
+        x3 = _mm256_fmadd_pd(x, xx, x3);
+        x2y = _mm256_fmadd_pd(xx, y, x2y);
+        xy2 = _mm256_fmadd_pd(x, yy, xy2);
+        y3 = _mm256_fmadd_pd(y, yy, y3);
+        x4 = _mm256_fmadd_pd(xx, xx, x4);
+        x3y = _mm256_fmadd_pd(xx, xY, x3y);
+        x2y2 = _mm256_fmadd_pd(xx, yy, x2y2);
+        xy3 = _mm256_fmadd_pd(xY, yy, xy3);
+        y4 = _mm256_fmadd_pd(yy, yy, y4);
+    }
+
+    M[1][0] += HorizontalSum(x1);   M[0][1] += HorizontalSum(y1);
+    M[2][0] += HorizontalSum(x2);   M[1][1] += HorizontalSum(xy);   M[0][2] += HorizontalSum(y2);
+    M[3][0] += HorizontalSum(x3);   M[2][1] += HorizontalSum(x2y);  M[1][2] += HorizontalSum(xy2);  M[0][3] += HorizontalSum(y3);
+    M[4][0] += HorizontalSum(x4);   M[3][1] += HorizontalSum(x3y);  M[2][2] += HorizontalSum(x2y2); M[1][3] += HorizontalSum(xy3);  M[0][4] += HorizontalSum(y4);
+
+    return i;
+}
+
+// The ellipse moments 8 points at a time.  Returns the number of points summed (a multiple of 8).
+static TARGET_AVX512 int EllipseSumsAVX512(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, double M[5][5])
+{
+    auto x1 = _mm512_setzero_pd(), y1 = _mm512_setzero_pd();
+    auto x2 = _mm512_setzero_pd(), xy = _mm512_setzero_pd(), y2 = _mm512_setzero_pd();
+    auto x3 = _mm512_setzero_pd(), x2y = _mm512_setzero_pd(), xy2 = _mm512_setzero_pd(), y3 = _mm512_setzero_pd();
+    auto x4 = _mm512_setzero_pd(), x3y = _mm512_setzero_pd(), x2y2 = _mm512_setzero_pd(), xy3 = _mm512_setzero_pd(), y4 = _mm512_setzero_pd();
+
+    auto index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride, 4 * stride, 5 * stride, 6 * stride, 7 * stride);
+    auto bx = _mm256_set1_ps(biasX);
+    auto by = _mm256_set1_ps(biasY);
+    auto i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto x = Load8(xs, i, stride, index, bx);
+        auto y = Load8(ys, i, stride, index, by);
+        auto xx = _mm512_mul_pd(x, x);
+        auto xY = _mm512_mul_pd(x, y);
+        auto yy = _mm512_mul_pd(y, y);
+
+        x1 = _mm512_add_pd(x1, x);
+        y1 = _mm512_add_pd(y1, y);
+        x2 = _mm512_add_pd(x2, xx);
+        xy = _mm512_add_pd(xy, xY);
+        y2 = _mm512_add_pd(y2, yy);
+        x3 = _mm512_fmadd_pd(x, xx, x3);
+        x2y = _mm512_fmadd_pd(xx, y, x2y);
+        xy2 = _mm512_fmadd_pd(x, yy, xy2);
+        y3 = _mm512_fmadd_pd(y, yy, y3);
+        x4 = _mm512_fmadd_pd(xx, xx, x4);
+        x3y = _mm512_fmadd_pd(xx, xY, x3y);
+        x2y2 = _mm512_fmadd_pd(xx, yy, x2y2);
+        xy3 = _mm512_fmadd_pd(xY, yy, xy3);
+        y4 = _mm512_fmadd_pd(yy, yy, y4);
+    }
+
+    M[1][0] += _mm512_reduce_add_pd(x1);    M[0][1] += _mm512_reduce_add_pd(y1);
+    M[2][0] += _mm512_reduce_add_pd(x2);    M[1][1] += _mm512_reduce_add_pd(xy);    M[0][2] += _mm512_reduce_add_pd(y2);
+    M[3][0] += _mm512_reduce_add_pd(x3);    M[2][1] += _mm512_reduce_add_pd(x2y);   M[1][2] += _mm512_reduce_add_pd(xy2);
+    M[0][3] += _mm512_reduce_add_pd(y3);
+    M[4][0] += _mm512_reduce_add_pd(x4);    M[3][1] += _mm512_reduce_add_pd(x3y);   M[2][2] += _mm512_reduce_add_pd(x2y2);
+    M[1][3] += _mm512_reduce_add_pd(xy3);   M[0][4] += _mm512_reduce_add_pd(y4);
+
+    return i;
+}
+
+// The low 32 bits of each lane of a double comparison, as a float mask
+static TARGET_AVX2 __m128 NarrowMask(__m256d mask)
+{
+    auto narrowed = _mm256_permutevar8x32_epi32(_mm256_castpd_si256(mask), _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+    return _mm_castsi128_ps(_mm256_castsi256_si128(narrowed));
+}
+
+// The ellipse errors 4 points at a time.  Returns the number of points done (a multiple of 4).  The operations 
+// are those of the scalar loop (no fused multiply-adds), so the errors are the same.
+static NO_CONTRACTION TARGET_AVX2 int EllipseErrorsAVX2(const float* xs, const float* ys, int count, int stride, const double k[6], double biasX, double biasY,
+    float* errors)
+{
+    auto a = _mm256_set1_pd(k[0]), b = _mm256_set1_pd(k[1]), c = _mm256_set1_pd(k[2]);
+    auto d = _mm256_set1_pd(k[3]), e = _mm256_set1_pd(k[4]), f = _mm256_set1_pd(k[5]);
+    auto fourA = _mm256_set1_pd(4 * k[0]), fourC = _mm256_set1_pd(4 * k[2]);
+    auto twoA = _mm256_set1_pd(2.0 * k[0]), twoC = _mm256_set1_pd(2.0 * k[2]);
+    auto bx = _mm256_set1_pd(biasX), by = _mm256_set1_pd(biasY);
+    auto floatBiasX = _mm_set1_ps((float)biasX), floatBiasY = _mm_set1_ps((float)biasY);
+    auto zero = _mm256_setzero_pd();
+    auto sign = _mm256_set1_pd(-0.0);
+    auto absolute = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    auto noCrossing = _mm_set1_ps(SummationKernels::NO_CROSSING);
+
+    auto index = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+    auto i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        auto X = stride == 1 ? _mm_loadu_ps(xs + i) : _mm_i32gather_ps(xs + i * stride, index, 4);
+        auto Y = stride == 1 ? _mm_loadu_ps(ys + i) : _mm_i32gather_ps(ys + i * stride, index, 4);
+        auto x = _mm256_sub_pd(_mm256_cvtps_pd(X), bx);
+        auto y = _mm256_sub_pd(_mm256_cvtps_pd(Y), by);
+
+        // The y-values at x
+        auto B = _mm256_add_pd(_mm256_mul_pd(b, x), e);
+        auto C = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(a, x), x), _mm256_mul_pd(d, x)), f);
+        auto discriminant = _mm256_sub_pd(_mm256_mul_pd(B, B), _mm256_mul_pd(fourC, C));
+        auto root = _mm256_sqrt_pd(_mm256_max_pd(discriminant, zero));
+        auto minusB = _mm256_xor_pd(B, sign);
+        auto crosses = NarrowMask(_mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ));
+        auto top = _mm_add_ps(_mm256_cvtpd_ps(_mm256_div_pd(_mm256_add_pd(minusB, root), twoC)), floatBiasY);
+        auto bottom = _mm_add_ps(_mm256_cvtpd_ps(_mm256_div_pd(_mm256_sub_pd(minusB, root), twoC)), floatBiasY);
+        top = _mm_blendv_ps(noCrossing, top, crosses);
+        bottom = _mm_blendv_ps(noCrossing, bottom, crosses);
+        auto errorV = _mm_min_ps(_mm_and_ps(_mm_sub_ps(bottom, Y), absolute), _mm_and_ps(_mm_sub_ps(top, Y), absolute));
+
+        // The x-values at y
+        B = _mm256_add_pd(_mm256_mul_pd(b, y), d);
+        C = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(c, y), y), _mm256_mul_pd(e, y)), f);
+        discriminant = _mm256_sub_pd(_mm256_mul_pd(B, B), _mm256_mul_pd(fourA, C));
+        root = _mm256_sqrt_pd(_mm256_max_pd(discriminant, zero));
+        minusB = _mm256_xor_pd(B, sign);
+        crosses = NarrowMask(_mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ));
+        auto right = _mm_add_ps(_mm256_cvtpd_ps(_mm256_div_pd(_mm256_add_pd(minusB, root), twoA)), floatBiasX);
+        auto left = _mm_add_ps(_mm256_cvtpd_ps(_mm256_div_pd(_mm256_sub_pd(minusB, root), twoA)), floatBiasX);
+        right = _mm_blendv_ps(noCrossing, right, crosses);
+        left = _mm_blendv_ps(noCrossing, left, crosses);
+        auto errorH = _mm_min_ps(_mm_and_ps(_mm_sub_ps(left, X), absolute), _mm_and_ps(_mm_sub_ps(right, X), absolute));
+
+        // min(a, b) is (b < a) ? b : a, which is _mm_min_ps(b, a)
+        _mm_storeu_ps(errors + i, _mm_min_ps(errorH, errorV));
+    }
+
+    return i;
+}
+
+// value where the mask is set, otherwise noCrossing (with AVX-512F alone, which has no 256-bit mask blend)
+static TARGET_AVX512 __m256 SelectCrossing(__mmask8 crosses, __m256 value, __m256 noCrossing)
+{
+    auto selected = _mm512_mask_blend_ps((__mmask16)crosses, _mm512_castps256_ps512(noCrossing), _mm512_castps256_ps512(value));
+    return _mm512_castps512_ps256(selected);
+}
+
+// The ellipse errors 8 points at a time.  Returns the number of points done (a multiple of 8).
+static NO_CONTRACTION TARGET_AVX512 int EllipseErrorsAVX512(const float* xs, const float* ys, int count, int stride, const double k[6], double biasX, double biasY,
+    float* errors)
+{
+    auto a = _mm512_set1_pd(k[0]), b = _mm512_set1_pd(k[1]), c = _mm512_set1_pd(k[2]);
+    auto d = _mm512_set1_pd(k[3]), e = _mm512_set1_pd(k[4]), f = _mm512_set1_pd(k[5]);
+    auto fourA = _mm512_set1_pd(4 * k[0]), fourC = _mm512_set1_pd(4 * k[2]);
+    auto twoA = _mm512_set1_pd(2.0 * k[0]), twoC = _mm512_set1_pd(2.0 * k[2]);
+    auto bx = _mm512_set1_pd(biasX), by = _mm512_set1_pd(biasY);
+    auto floatBiasX = _mm256_set1_ps((float)biasX), floatBiasY = _mm256_set1_ps((float)biasY);
+    auto zero = _mm512_setzero_pd();
+    auto absolute = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    auto noCrossing = _mm256_set1_ps(SummationKernels::NO_CROSSING);
+
+    auto index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride, 4 * stride, 5 * stride, 6 * stride, 7 * stride);
+    auto i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto X = stride == 1 ? _mm256_loadu_ps(xs + i) : _mm256_i32gather_ps(xs + i * stride, index, 4);
+        auto Y = stride == 1 ? _mm256_loadu_ps(ys + i) : _mm256_i32gather_ps(ys + i * stride, index, 4);
+        auto x = _mm512_sub_pd(_mm512_cvtps_pd(X), bx);
+        auto y = _mm512_sub_pd(_mm512_cvtps_pd(Y), by);
+
+        // The y-values at x
+        auto B = _mm512_add_pd(_mm512_mul_pd(b, x), e);
+        auto C = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(a, x), x), _mm512_mul_pd(d, x)), f);
+        auto discriminant = _mm512_sub_pd(_mm512_mul_pd(B, B), _mm512_mul_pd(fourC, C));
+        auto root = _mm512_sqrt_pd(_mm512_max_pd(discriminant, zero));
+        auto minusB = _mm512_sub_pd(zero, B);
+        auto crosses = _mm512_cmp_pd_mask(discriminant, zero, _CMP_GE_OQ);
+        auto top = _mm256_add_ps(_mm512_cvtpd_ps(_mm512_div_pd(_mm512_add_pd(minusB, root), twoC)), floatBiasY);
+        auto bottom = _mm256_add_ps(_mm512_cvtpd_ps(_mm512_div_pd(_mm512_sub_pd(minusB, root), twoC)), floatBiasY);
+        top = SelectCrossing(crosses, top, noCrossing);
+        bottom = SelectCrossing(crosses, bottom, noCrossing);
+        auto errorV = _mm256_min_ps(_mm256_and_ps(_mm256_sub_ps(bottom, Y), absolute), _mm256_and_ps(_mm256_sub_ps(top, Y), absolute));
+
+        // The x-values at y
+        B = _mm512_add_pd(_mm512_mul_pd(b, y), d);
+        C = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(c, y), y), _mm512_mul_pd(e, y)), f);
+        discriminant = _mm512_sub_pd(_mm512_mul_pd(B, B), _mm512_mul_pd(fourA, C));
+        root = _mm512_sqrt_pd(_mm512_max_pd(discriminant, zero));
+        minusB = _mm512_sub_pd(zero, B);
+        crosses = _mm512_cmp_pd_mask(discriminant, zero, _CMP_GE_OQ);
+        auto right = _mm256_add_ps(_mm512_cvtpd_ps(_mm512_div_pd(_mm512_add_pd(minusB, root), twoA)), floatBiasX);
+        auto left = _mm256_add_ps(_mm512_cvtpd_ps(_mm512_div_pd(_mm512_sub_pd(minusB, root), twoA)), floatBiasX);
+        right = SelectCrossing(crosses, right, noCrossing);
+        left = SelectCrossing(crosses, left, noCrossing);
+        auto errorH = _mm256_min_ps(_mm256_and_ps(_mm256_sub_ps(left, X), absolute), _mm256_and_ps(_mm256_sub_ps(right, X), absolute));
+
+        _mm256_storeu_ps(errors + i, _mm256_min_ps(errorH, errorV));
+    }
+
+    return i;
+}
+
+// The Sampson errors 4 points at a time.  Returns the number of points done (a multiple of 4).
+static NO_CONTRACTION TARGET_AVX2 int EllipseSampsonErrorsAVX2(const float* xs, const float* ys, int count, int stride, const double k[6],
+    double biasX, double biasY, float* errors)
+{
+    auto a = _mm256_set1_pd(k[0]), b = _mm256_set1_pd(k[1]), c = _mm256_set1_pd(k[2]);
+    auto d = _mm256_set1_pd(k[3]), e = _mm256_set1_pd(k[4]), f = _mm256_set1_pd(k[5]);
+    auto twoA = _mm256_set1_pd(2.0 * k[0]), twoC = _mm256_set1_pd(2.0 * k[2]);
+    auto bx = _mm256_set1_pd(biasX), by = _mm256_set1_pd(biasY);
+    auto absolute = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+
+    auto index = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+    auto i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        auto X = stride == 1 ? _mm_loadu_ps(xs + i) : _mm_i32gather_ps(xs + i * stride, index, 4);
+        auto Y = stride == 1 ? _mm_loadu_ps(ys + i) : _mm_i32gather_ps(ys + i * stride, index, 4);
+        auto x = _mm256_sub_pd(_mm256_cvtps_pd(X), bx);
+        auto y = _mm256_sub_pd(_mm256_cvtps_pd(Y), by);
+
+        auto Q = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(a, x), x), _mm256_mul_pd(_mm256_mul_pd(b, x), y));
+        Q = _mm256_add_pd(Q, _mm256_mul_pd(_mm256_mul_pd(c, y), y));
+        Q = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(Q, _mm256_mul_pd(d, x)), _mm256_mul_pd(e, y)), f);
+        auto gradientX = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(twoA, x), _mm256_mul_pd(b, y)), d);
+        auto gradientY = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(b, x), _mm256_mul_pd(twoC, y)), e);
+        auto norm = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(gradientX, gradientX), _mm256_mul_pd(gradientY, gradientY)));
+        _mm_storeu_ps(errors + i, _mm256_cvtpd_ps(_mm256_div_pd(_mm256_and_pd(Q, absolute), norm)));
+    }
+
+    return i;
+}
+
+// The Sampson errors 8 points at a time.  Returns the number of points done (a multiple of 8).
+static NO_CONTRACTION TARGET_AVX512 int EllipseSampsonErrorsAVX512(const float* xs, const float* ys, int count, int stride, const double k[6],
+    double biasX, double biasY, float* errors)
+{
+    auto a = _mm512_set1_pd(k[0]), b = _mm512_set1_pd(k[1]), c = _mm512_set1_pd(k[2]);
+    auto d = _mm512_set1_pd(k[3]), e = _mm512_set1_pd(k[4]), f = _mm512_set1_pd(k[5]);
+    auto twoA = _mm512_set1_pd(2.0 * k[0]), twoC = _mm512_set1_pd(2.0 * k[2]);
+    auto bx = _mm512_set1_pd(biasX), by = _mm512_set1_pd(biasY);
+
+    auto index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride, 4 * stride, 5 * stride, 6 * stride, 7 * stride);
+    auto i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto X = stride == 1 ? _mm256_loadu_ps(xs + i) : _mm256_i32gather_ps(xs + i * stride, index, 4);
+        auto Y = stride == 1 ? _mm256_loadu_ps(ys + i) : _mm256_i32gather_ps(ys + i * stride, index, 4);
+        auto x = _mm512_sub_pd(_mm512_cvtps_pd(X), bx);
+        auto y = _mm512_sub_pd(_mm512_cvtps_pd(Y), by);
+
+        auto Q = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(a, x), x), _mm512_mul_pd(_mm512_mul_pd(b, x), y));
+        Q = _mm512_add_pd(Q, _mm512_mul_pd(_mm512_mul_pd(c, y), y));
+        Q = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(Q, _mm512_mul_pd(d, x)), _mm512_mul_pd(e, y)), f);
+        auto gradientX = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(twoA, x), _mm512_mul_pd(b, y)), d);
+        auto gradientY = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(b, x), _mm512_mul_pd(twoC, y)), e);
+        auto norm = _mm512_sqrt_pd(_mm512_add_pd(_mm512_mul_pd(gradientX, gradientX), _mm512_mul_pd(gradientY, gradientY)));
+        _mm256_storeu_ps(errors + i, _mm512_cvtpd_ps(_mm512_div_pd(_mm512_abs_pd(Q), norm)));
+    }
+
+    return i;
+}
+
+#endif
+
+void SummationKernels::PolynomialSums(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, int degree,
+    double* sumX, double* sumXY, double& sumY2)
+{
+    sumX[0] = count;
+    for (auto k = 1; k <= 2 * degree; ++k)
+    {
+        sumX[k] = 0.0;
+    }
+    for (auto k = 0; k <= degree; ++k)
+    {
+        sumXY[k] = 0.0;
+    }
+    sumY2 = 0.0;
+
+    // The vector kernel sums whole vectors of points, and the scalar loop sums the rest
+    auto summed = 0;
+#if defined(SUMMATION_KERNELS_X86)
+    auto set = ActiveInstructionSet();
+    if (set != InstructionSet::Scalar)
+    {
+        switch (degree)
+        {
+        case 1:
+            summed = PolynomialSumsVector<1>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 2:
+            summed = PolynomialSumsVector<2>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 3:
+            summed = PolynomialSumsVector<3>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 4:
+            summed = PolynomialSumsVector<4>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 5:
+            summed = PolynomialSumsVector<5>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 6:
+            summed = PolynomialSumsVector<6>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 7:
+            summed = PolynomialSumsVector<7>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        case 8:
+            summed = PolynomialSumsVector<8>(set, xs, ys, count, stride, biasX, biasY, sumX, sumXY, sumY2);
+            break;
+        }
+    }
+#endif
+
+    PolynomialSumsScalar(xs, ys, summed, count, stride, biasX, biasY, degree, sumX, sumXY, sumY2);
+}
+
+void SummationKernels::EllipseSums(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, double M[5][5])
+{
+    for (auto i = 0; i < 5; ++i)
+    {
+        for (auto j = 0; j < 5; ++j)
+        {
+            M[i][j] = 0.0;
+        }
+    }
+    M[0][0] = count;
+
+    auto summed = 0;
+#if defined(SUMMATION_KERNELS_X86)
+    auto set = ActiveInstructionSet();
+    if (set == InstructionSet::AVX512)
+    {
+        summed = EllipseSumsAVX512(xs, ys, count, stride, biasX, biasY, M);
+    }
+    else if (set == InstructionSet::AVX2)
+    {
+        summed = EllipseSumsAVX2(xs, ys, count, stride, biasX, biasY, M);
+    }
+#endif
+
+    EllipseSumsScalar(xs, ys, summed, count, stride, biasX, biasY, M);
+}
+
+void SummationKernels::EllipseErrors(const float* xs, const float* ys, int count, int stride, const double coefficients[6], double biasX, double biasY,
+    float* errors)
+{
+    auto done = 0;
+#if defined(SUMMATION_KERNELS_X86)
+    auto set = ActiveInstructionSet();
+    if (set == InstructionSet::AVX512)
+    {
+        done = EllipseErrorsAVX512(xs, ys, count, stride, coefficients, biasX, biasY, errors);
+    }
+    else if (set == InstructionSet::AVX2)
+    {
+        done = EllipseErrorsAVX2(xs, ys, count, stride, coefficients, biasX, biasY, errors);
+    }
+#endif
+
+    EllipseErrorsScalar(xs, ys, done, count, stride, coefficients, biasX, biasY, errors);
+}
+
+void SummationKernels::EllipseSampsonErrors(const float* xs, const float* ys, int count, int stride, const double coefficients[6], double biasX,
+    double biasY, float* errors)
+{
+    auto done = 0;
+#if defined(SUMMATION_KERNELS_X86)
+    auto set = ActiveInstructionSet();
+    if (set == InstructionSet::AVX512)
+    {
+        done = EllipseSampsonErrorsAVX512(xs, ys, count, stride, coefficients, biasX, biasY, errors);
+    }
+    else if (set == InstructionSet::AVX2)
+    {
+        done = EllipseSampsonErrorsAVX2(xs, ys, count, stride, coefficients, biasX, biasY, errors);
+    }
+#endif
+
+    EllipseSampsonErrorsScalar(xs, ys, done, count, stride, coefficients, biasX, biasY, errors);
+}
+
+// True if a sum from a vector kernel matches the scalar loop's, which differs only in the order of the additions
+static bool MatchesScalar(double sum, double scalarSum)
+{
+    return abs(sum - scalarSum) <= 1e-12 * abs(scalarSum);
+}
+
+int SummationKernels::UnitTest1()
+{
+    /////////////////////////////////////////////////////////////////////////////
+    // Unit test #1:  Every instruction set sums as the scalar loop does       //
+    /////////////////////////////////////////////////////////////////////////////
+
+    // 37 points (not a multiple of any vector width, so the scalar tail is summed as well), each 1 to 3 from the 
+    // bias so that no power sum cancels, read from separate arrays (stride 1) and interleaved as in PointF 
+    // (stride 3, which the vector kernels gather).  The polynomial sums of every degree with a vector kernel and 
+    // the ellipse moments from each instruction set up to Supported() should match the scalar loop's to rounding.
+
+    const int COUNT = 37;
+    const int STRIDE = 3;
+    const float BIAS_X = 99.0f;
+    const float BIAS_Y = 199.0f;
+    float xs[COUNT], ys[COUNT], interleaved[STRIDE * COUNT];
+    for (auto i = 0; i < COUNT; ++i)
+    {
+        xs[i] = BIAS_X + 1.0f + 2.0f * i / (COUNT - 1);
+        ys[i] = BIAS_Y + 1.0f + 2.0f * (i * 7 % COUNT) / (COUNT - 1);
+        interleaved[STRIDE * i] = xs[i];
+        interleaved[STRIDE * i + 1] = ys[i];
+        interleaved[STRIDE * i + 2] = 0.0f;
+    }
+
+    const int SUMS = 2 * MAXIMUM_VECTOR_DEGREE + 1;
+    auto setting = instructionSet;
+    auto result = 0;
+    for (auto set = (int)InstructionSet::Scalar + 1; set <= (int)Supported() && result == 0; ++set)
+    {
+        for (auto stride = 1; stride <= STRIDE && result == 0; stride += STRIDE - 1)
+        {
+            auto x = stride == 1 ? xs : interleaved;
+            auto y = stride == 1 ? ys : interleaved + 1;
+
+            for (auto degree = 1; degree <= MAXIMUM_VECTOR_DEGREE; ++degree)
+            {
+                double scalarSumX[SUMS], scalarSumXY[SUMS], scalarSumY2;
+                instructionSet = InstructionSet::Scalar;
+                PolynomialSums(x, y, COUNT, stride, BIAS_X, BIAS_Y, degree, scalarSumX, scalarSumXY, scalarSumY2);
+
+                double sumX[SUMS], sumXY[SUMS], sumY2;
+                instructionSet = (InstructionSet)set;
+                PolynomialSums(x, y, COUNT, stride, BIAS_X, BIAS_Y, degree, sumX, sumXY, sumY2);
+
+                result = MatchesScalar(sumY2, scalarSumY2) ? result : 1;
+                for (auto k = 0; k <= 2 * degree; ++k)
+                {
+                    result = MatchesScalar(sumX[k], scalarSumX[k]) && (k > degree || MatchesScalar(sumXY[k], scalarSumXY[k])) ? result : 1;
+                }
+            }
+
+            double scalarM[5][5], M[5][5];
+            instructionSet = InstructionSet::Scalar;
+            EllipseSums(x, y, COUNT, stride, BIAS_X, BIAS_Y, scalarM);
+            instructionSet = (InstructionSet)set;
+            EllipseSums(x, y, COUNT, stride, BIAS_X, BIAS_Y, M);
+            for (auto i = 0; i <= 4; ++i)
+            {
+                for (auto j = 0; i + j <= 4; ++j)
+                {
+                    result = MatchesScalar(M[i][j], scalarM[i][j]) ? result : 2;
+                }
+            }
+        }
+    }
+
+    instructionSet = setting;
+    return result;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+/// <summary>
+/// SummationKernels
+/// Description:  The summation loops of the regression models, which are most of the cost of fitting many points,
+///   and the ellipse error loop, which is most of the cost of scoring an ellipse.  Each summation kernel removes a
+///   bias from the points (in float, as UpdateSummations does) and accumulates their power sums in double
+///   precision.  The kernels use AVX-512 or AVX2 where the CPU supports it (detected once, at startup) and a
+///   scalar loop otherwise.  The coordinates are read from separate x and y arrays with a stride in floats (1 for
+///   a PointCloud2D that owns its arrays, 3 for a view of PointF, which the vector kernels gather).
+///
+///   Lanes accumulate separately and are added at the end, so the sums differ from the scalar loop in rounding.
+///   The ellipse errors are the same in every lane as in the scalar loop.
+/// </summary>
+///
+class SummationKernels
+{
+public:
+    enum class InstructionSet
+    {
+        Scalar = 0,
+        AVX2 = 1,                   // With FMA
+        AVX512 = 2                  // AVX-512F
+    };
+
+    // The kernels used, initially the best the CPU supports.  Set lower to compare against the scalar loop; a
+    // setting higher than Supported() is treated as Supported().
+    static InstructionSet instructionSet;
+
+    // The best instruction set the CPU (and operating system) supports
+    static InstructionSet Supported();
+
+    // The largest polynomial degree with a vector kernel (higher degrees use the scalar loop)
+    const static int MAXIMUM_VECTOR_DEGREE = 8;
+
+    // The power sums of a polynomial of the given degree in x, of the points less (biasX, biasY):
+    //   sumX[k] = SUM(x^k), k = 0..2*degree     sumXY[k] = SUM(x^k * y), k = 0..degree     sumY2 = SUM(y^2)
+    // Swap the arrays (and the biases) for a y independent variable.
+    static void PolynomialSums(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, int degree,
+        double* sumX, double* sumXY, double& sumY2);
+
+    // The moments of the points less (biasX, biasY) up to the fourth order:
+    //   M[i][j] = SUM(x^i * y^j), i + j <= 4
+    static void EllipseSums(const float* xs, const float* ys, int count, int stride, float biasX, float biasY, double M[5][5]);
+
+    // The value EllipticalRegression::CalculateError starts from, for each point: the distance along y to the 
+    // nearer of the top and bottom halves of the ellipse  a x^2 + b xy + c y^2 + d x + e y + f = 0  (in the frame 
+    // of the bias, coefficients in the order a..f), the same along x to the left and right halves, and the 
+    // smaller of the two.  A half that the line through the point does not cross is at NO_CROSSING, as in 
+    // ModeledY and ModeledX, so the caller applies CalculateError's fallback to errors that are out of range.
+    static void EllipseErrors(const float* xs, const float* ys, int count, int stride, const double coefficients[6], double biasX, double biasY,
+        float* errors);
+
+    // The Sampson distance of each point from the same ellipse, |Q| / |grad Q| of  Q(x, y) = a x^2 + ... + f,  as 
+    // EllipticalRegression::CalculateSampsonError computes it (infinite or NaN where the gradient is zero)
+    static void EllipseSampsonErrors(const float* xs, const float* ys, int count, int stride, const double coefficients[6], double biasX,
+        double biasY, float* errors);
+
+    // The modeled coordinate of a half of the ellipse that is not crossed
+    const static float NO_CROSSING;
+
+public: // Unit tests
+    // Checks that return 0 on success and non-zero on failure
+    static int UnitTest1();
+};